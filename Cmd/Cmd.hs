@@ -526,16 +526,19 @@ data Config = Config {
     , config_git_user :: !SaveGit.User
     } deriving (Show)
 
--- | Get a midi writer that takes the 'config_wdev_map' into account.
-state_midi_writer :: State -> Midi.Interface.Message -> IO ()
-state_midi_writer state imsg = do
-    let out = case imsg of
-            Midi.Interface.Midi wmsg -> Midi.Interface.Midi $ map_wdev wmsg
-            _ -> imsg
-    ok <- Midi.Interface.write_message
+-- | Get a midi writer that takes the 'config_wdev_map' into account.  The
+-- messages are written as one batch.
+state_midi_writer :: State -> [Midi.Interface.Message] -> IO ()
+state_midi_writer _ [] = return ()
+state_midi_writer state imsgs = do
+    let out = map map_msg imsgs
+    ok <- Midi.Interface.write_messages
         (config_midi_interface (state_config state)) out
     unless ok $ Log.warn $ "error writing " <> pretty out
     where
+    map_msg imsg = case imsg of
+        Midi.Interface.Midi wmsg -> Midi.Interface.Midi $ map_wdev wmsg
+        _ -> imsg
     map_wdev (Midi.WriteMessage wdev time msg) =
         Midi.WriteMessage (lookup_wdev wdev) time msg
     lookup_wdev wdev = Map.findWithDefault wdev wdev
@@ -119,11 +119,16 @@ update_track_signals ui_chan block_id state tsigs =
     case rendering_tracks block_id state of
         -- This means a bad BlockId or bug in rendering_tracks.
         Left err -> Log.error $ pretty err
+        -- Every view of a track gets the same signal, so group them to
+        -- share it.
         Right tracks -> Sync.set_track_signals ui_chan $
-            [ (view_id, tracknum, if wants_tsig
+            [ (view_tracks, if wants_tsig
                 then Map.findWithDefault empty (block_id, track_id) tsigs
                 else empty)
-            | (view_id, track_id, tracknum, wants_tsig) <- tracks
+            | ((track_id, wants_tsig), view_tracks) <- Seq.group_fst
+                [ ((track_id, wants_tsig), (view_id, tracknum))
+                | (view_id, track_id, tracknum, wants_tsig) <- tracks
+                ]
             ]
     where
     -- If there's no recorded signal, I send an empty one, to make sure that if
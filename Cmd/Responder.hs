@@ -499,7 +499,7 @@ run_cmd cmd = do
             Cmd.run_io (rstate_ui_to rstate) (rstate_cmd_to rstate) cmd
     liftIO $ do
         mapM_ Log.write logs
-        mapM_ (Cmd.state_midi_writer (rstate_cmd_to rstate)) midi
+        Cmd.state_midi_writer (rstate_cmd_to rstate) midi
     case result of
         Left err -> return (Left err, cmd_state)
         Right (status, ui_state, updates) -> do
@@ -324,7 +324,13 @@ make_midi_interface = do
     midi_chan <- new_chan
     int <- StubMidi.interface
     let write msg = put_val midi_chan msg >> return True
-    return (int { Interface.write_message = write }, midi_chan)
+    return
+        ( int
+            { Interface.write_message = write
+            , Interface.write_messages = Interface.write_each write
+            }
+        , midi_chan
+        )
 
 -- Use a TVar as a kind of non-blocking channel.
 new_chan :: IO (TVar.TVar [a])
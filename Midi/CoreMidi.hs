@@ -84,6 +84,9 @@ initialize app_name want_message app = do
         , Interface.disconnect_read_device = disconnect_read_device client
         , Interface.connect_write_device = connect_write_device client
         , Interface.write_message = write_message client
+        , Interface.write_messages = Interface.write_each (write_message client)
+        -- TODO CoreMIDI thru connections could do this.
+        , Interface.set_thru_routes = const (return False)
         , Interface.abort = abort
         , Interface.now = now
         }
@@ -53,9 +53,20 @@ data RawInterface write_message = Interface {
     -- more than a thousand or so pending.  False if the WriteDevice isn't
     -- connected.
     --
-    -- Messages should be written in increasing time order, with a special
-    -- case that timestamp 0 messages will be written immediately.
+    -- Timestamp 0 messages are written immediately.  On JACK, messages may
+    -- be written out of order, and go out in time order, with messages at
+    -- the same time in the order they were written.  CoreMIDI doesn't sort
+    -- them, so there they should still be written in increasing time order.
     , write_message :: write_message -> IO Bool
+    -- | Write a batch of messages.  This is the same as 'write_message' on
+    -- each one, but the driver may be able to do it in one call, so
+    -- a player should prefer this.  False if any of them failed.
+    , write_messages :: [write_message] -> IO Bool
+    -- | Replace the driver's thru routes.  Matching channel messages go
+    -- straight from a ReadDevice to a WriteDevice without a trip through
+    -- the app, though they still show up on 'read_channel'.  False if the
+    -- driver doesn't support it, or a device isn't connected.
+    , set_thru_routes :: [ThruRoute] -> IO Bool
     -- | Deschedule all pending write messages.
     , abort :: IO ()
     -- | Current time according to the MIDI driver.
@@ -67,6 +78,17 @@ instance Show (RawInterface a) where
 
 type Interface = RawInterface Message
 
+-- | Route channel messages from a ReadDevice to a WriteDevice, see
+-- 'set_thru_routes'.
+data ThruRoute = ThruRoute {
+    thru_from :: !Midi.ReadDevice
+    , thru_to :: !Midi.WriteDevice
+    -- | Only messages on these channels go thru.  Empty means all of them.
+    , thru_channels :: ![Midi.Channel]
+    -- | Change the channel to this one.
+    , thru_rechannel :: !(Maybe Midi.Channel)
+    } deriving (Show)
+
 -- | Annotate a WriteMessage with additional control messages.
 data Message =
     Midi !Midi.WriteMessage
@@ -92,8 +114,16 @@ instance DeepSeq.NFData Message where
 
 track_interface :: RawInterface Midi.WriteMessage -> IO Interface
 track_interface interface = do
-    tracker <- note_tracker (write_message interface)
-    return $ interface { write_message = tracker }
+    tracker <- note_tracker (write_messages interface)
+    return $ interface
+        { write_message = tracker . (:[])
+        , write_messages = tracker
+        }
+
+-- | Implement 'write_messages' for a driver that can only write one at
+-- a time.
+write_each :: (a -> IO Bool) -> [a] -> IO Bool
+write_each write = fmap and . mapM write
 
 reset_pitch :: RealTime -> Message
 reset_pitch time = AllDevices time $ all_channels (Midi.PitchBend 0)
@@ -113,23 +143,26 @@ type State = Map Midi.WriteDevice (Vector.Vector (Mutable.IOVector Bool))
 run :: State -> TrackerM Bool -> IO (State, Bool)
 run state = fmap Tuple.swap . flip State.runStateT state
 
--- | Wrap a 'write_message' and keep track of which notes are on.  It can
+-- | Wrap a 'write_messages' and keep track of which notes are on.  It can
 -- then handle reset messages which need to know current state to reset it.
+-- The messages expanded from a batch are written as a single batch.
 --
 -- This is necessary because some synthesizers do not support AllNotesOff,
 -- but also relieves callers of having to track which devices and channels
 -- have active notes.
-note_tracker :: (Midi.WriteMessage -> IO Bool) -> IO (Message -> IO Bool)
+note_tracker :: ([Midi.WriteMessage] -> IO Bool)
+    -> IO ([Message] -> IO Bool)
 note_tracker write = do
     mstate <- MVar.newMVar Map.empty
-    return $ \msg -> MVar.modifyMVar mstate $ \state -> run state $ do
-        new_msgs <- handle_msg msg
-        liftIO $ do
-            mapM_ write new_msgs
-            case msg of
-                Midi wmsg -> write wmsg
-                _ -> return True
+    return $ \msgs -> MVar.modifyMVar mstate $ \state -> run state $ do
+        wmsgs <- concatMapM expand msgs
+        liftIO $ if null wmsgs then return True else write wmsgs
     where
+    expand msg = do
+        new_msgs <- handle_msg msg
+        return $ case msg of
+            Midi wmsg -> new_msgs ++ [wmsg]
+            _ -> new_msgs
     handle_msg (Midi wmsg) = do
         case Midi.wmsg_msg wmsg of
             Midi.ChannelMessage chan (Midi.NoteOn key vel)
@@ -45,6 +45,20 @@ test_note_tracker = do
         (f (end_with_off [(dev1, 0, note_on 10), (dev1, 0, note_off 10)]))
         [(dev1, 0, note_on 10), (dev1, 0, note_off 10)]
 
+test_note_tracker_batch = do
+    -- A batch expands to the same messages, in a single write.
+    let dev = Midi.write_device "dev"
+        msgs = map (Interface.Midi . mkmsg)
+            [(dev, 0, Midi.NoteOn 1 1), (dev, 1, Midi.NoteOn 2 1)]
+            ++ [Interface.AllNotesOff 0]
+    (out, writer) <- make_writer
+    tracked <- Interface.note_tracker writer
+    io_equal (tracked msgs) True
+    batches <- reverse <$> IORef.readIORef out
+    equal (length batches) 1
+    expected <- track msgs
+    equal (concat batches) expected
+
 mkmsg :: (Midi.WriteDevice, Midi.Channel, Midi.ChannelMessage)
     -> Midi.WriteMessage
 mkmsg (dev, chan, msg) =
@@ -60,8 +74,8 @@ track :: [Interface.Message] -> IO [Midi.WriteMessage]
 track msgs = do
     (out, writer) <- make_writer
     tracked <- Interface.note_tracker writer
-    mapM_ tracked msgs
-    reverse <$> IORef.readIORef out
+    mapM_ (tracked . (:[])) msgs
+    concat . reverse <$> IORef.readIORef out
 
 make_writer :: IO (IORef.IORef [a], a -> IO Bool)
 make_writer = do
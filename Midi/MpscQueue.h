@@ -0,0 +1,108 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+
+// A bounded lock-free queue with any number of writers and a single reader.
+//
+// This is Dmitry Vyukov's bounded queue: each cell has a sequence number
+// which tells whether it's ready to be written or read, so writers only
+// contend on the tail index, and never wait on each other.  It's realtime
+// safe on the reader side, which is meant to be the JACK process thread.
+//
+// The capacity must be a power of 2.
+template <class T> class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity) : mask(capacity - 1), cells(capacity)
+    {
+        for (size_t i = 0; i < capacity; i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        head = 0;
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    // Return false if the queue is full.
+    bool push(const T &val) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->val = val;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Push n values in one reservation, so they're contiguous in the queue.
+    // fill(i, &val) fills in the ith value.  If there isn't room for all of
+    // them, push nothing and return false.
+    template <class F> bool pushMany(size_t n, F fill) {
+        if (n == 0)
+            return true;
+        if (n > mask + 1)
+            return false;
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            // The reader frees cells in order, so if the last one is free,
+            // they all are.
+            Cell *last = &cells[(pos + n - 1) & mask];
+            size_t seq = last->seq.load(std::memory_order_acquire);
+            ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos + n - 1);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(
+                        pos, pos + n, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            Cell *cell = &cells[(pos + i) & mask];
+            fill(i, &cell->val);
+            cell->seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // Only the reader thread may call this.  Return false if it's empty.
+    bool pop(T *val) {
+        Cell *cell = &cells[head & mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        if (ptrdiff_t(seq) - ptrdiff_t(head + 1) < 0)
+            return false;
+        *val = cell->val;
+        cell->seq.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T val;
+    };
+    const size_t mask;
+    std::vector<Cell> cells;
+    // Only touched by the reader.
+    size_t head;
+    std::atomic<size_t> tail;
+};
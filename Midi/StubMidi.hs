@@ -31,6 +31,8 @@ interface = do
         , Interface.connect_write_device = const (return False)
         -- Return True, otherwise I get lots of spam in the logs.
         , Interface.write_message = const (return True)
+        , Interface.write_messages = const (return True)
+        , Interface.set_thru_routes = const (return False)
         , Interface.abort = return ()
         , Interface.now = do
             t <- Time.getCurrentTime
@@ -41,7 +41,13 @@ import Global
 type Interface = Interface.RawInterface Midi.WriteMessage
 
 main :: IO ()
-main = MidiDriver.initialize "test_midi" want_message test_midi
+main = do
+    args <- System.Environment.getArgs
+    case args of
+#if defined(JACK_MIDI)
+        ["latency", out_dev, in_dev] -> measure_latency out_dev in_dev
+#endif
+        _ -> MidiDriver.initialize "test_midi" want_message test_midi
     where
     want_message (Midi.RealtimeMessage Midi.ActiveSense) = False
     want_message _ = True
@@ -109,6 +115,14 @@ test_midi (Right interface) = do
             (write_msg, read_msg) <- open False
                 [Midi.read_device (txt loopback)] (Just loopback)
             run_tests interface write_msg read_msg
+        ["rt-thru", out_dev] -> do
+            putStrLn "playing thru in the driver"
+            (_, read_msg) <- open True rdevs (Just out_dev)
+            let wdev = Midi.write_device (txt out_dev)
+            ok <- Interface.set_thru_routes interface
+                [Interface.ThruRoute rdev wdev [] Nothing | rdev <- rdevs]
+            unless ok $ error "thru routes not supported"
+            monitor read_msg
         ["thru", out_dev] -> do
             putStrLn "playing thru"
             (write_msg, read_msg) <- open True rdevs (Just out_dev)
@@ -151,10 +165,26 @@ usage =
     \monitor <a> <b> ...  monitor input ports 'a' and 'b'\n\
     \help                 print this usage\n\
     \thru <out>           msgs from any input are relayed to <out>\n\
+    \rt-thru <out>        like thru, but the driver does the relaying\n\
     \melody <out>         play a melody on <out>, also relaying msgs thru\n\
     \spam <out> n         spam <out> with 'n' msgs in rapid succession\n\
     \test                 run some semi-automatic tests\n\
-    \pb-range <out> n     send pitch bend range\n"
+    \pb-range <out> n     send pitch bend range\n\
+    \latency <out> <in>   measure round trip through a loopback (JACK only)\n"
+
+
+#if defined(JACK_MIDI)
+-- * latency
+
+measure_latency :: String -> String -> IO ()
+measure_latency out_dev in_dev = do
+    putStrLn $ "measuring latency " ++ out_dev ++ " -> " ++ in_dev
+    result <- MidiDriver.measure_latency "test_midi_latency"
+        (Midi.write_device (txt out_dev)) (Midi.read_device (txt in_dev))
+        500 (RealTime.milliseconds 20)
+    putStr $ either (("error: "<>) . untxt) (untxt . MidiDriver.pretty_latency)
+        result
+#endif
 
 
 -- * program change
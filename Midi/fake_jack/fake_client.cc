@@ -0,0 +1,7 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// Midi/jack.cc, compiled against the fake JACK headers.  Shake builds one
+// object per source file, and the real one is linked into JackMidi.
+#include "Midi/jack.cc"
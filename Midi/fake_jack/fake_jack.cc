@@ -0,0 +1,773 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_jack.h"
+#include "jack/ringbuffer.h"
+
+
+namespace {
+
+struct PortBuffer {
+    std::vector<jack_midi_event_t> events;
+    std::vector<jack_midi_data_t> data;
+    size_t used;
+    uint32_t lost;
+};
+
+}
+
+struct _jack_client {
+    std::string name;
+    bool active;
+    JackProcessCallback process;
+    void *process_arg;
+    JackPortRegistrationCallback registration;
+    void *registration_arg;
+};
+
+struct _jack_port {
+    jack_port_id_t id;
+    std::string name;
+    std::string short_name;
+    unsigned long flags;
+    // Null for external device ports.
+    jack_client_t *client;
+    // Destinations, if this is an output.
+    std::vector<jack_port_t *> connections;
+    PortBuffer buffer;
+    // Events due to arrive on this port, sorted by time.  For a client input
+    // port, they appear in its buffer.  For an external output port, they go
+    // to its connections.
+    std::vector<FakeEvent> pending;
+    // Events received by an external input port.
+    std::vector<FakeEvent> received;
+};
+
+
+namespace {
+
+struct Server {
+    std::mutex lock;
+    std::vector<std::unique_ptr<_jack_client>> clients;
+    std::vector<std::unique_ptr<_jack_port>> ports;
+    jack_port_id_t next_id;
+    jack_nframes_t buffer_size;
+    jack_nframes_t sample_rate;
+    size_t port_buffer_bytes;
+    // Start of the current or next cycle.
+    jack_nframes_t frame;
+    std::vector<std::pair<std::string, std::string>> loopbacks;
+    FakeErrors errors;
+};
+
+Server server;
+
+}
+
+
+static jack_port_t *
+find_port(const char *name)
+{
+    for (auto &port : server.ports) {
+        if (port->name == name)
+            return port.get();
+    }
+    return nullptr;
+}
+
+
+static jack_port_t *
+add_port(const std::string &name, const std::string &short_name,
+    unsigned long flags, jack_client_t *client)
+{
+    std::unique_ptr<_jack_port> port(new _jack_port());
+    port->id = server.next_id++;
+    port->name = name;
+    port->short_name = short_name;
+    port->flags = flags;
+    port->client = client;
+    port->buffer.data.resize(server.port_buffer_bytes);
+    port->buffer.used = 0;
+    port->buffer.lost = 0;
+    server.ports.push_back(std::move(port));
+    return server.ports.back().get();
+}
+
+
+// Call registration callbacks.  This is called without the lock, since
+// the callbacks will likely call back into the API.
+static void
+notify_registration(jack_port_id_t id)
+{
+    std::vector<std::pair<JackPortRegistrationCallback, void *>> callbacks;
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        for (auto &client : server.clients) {
+            if (client->registration) {
+                callbacks.push_back(std::make_pair(
+                    client->registration, client->registration_arg));
+            }
+        }
+    }
+    for (auto &cb : callbacks)
+        cb.first(id, 1, cb.second);
+}
+
+
+// Insert into a sorted pending list, after any events with the same time.
+static void
+insert_pending(std::vector<FakeEvent> &pending, const FakeEvent &event)
+{
+    auto it = std::upper_bound(pending.begin(), pending.end(), event,
+        [](const FakeEvent &a, const FakeEvent &b) { return a.time < b.time; });
+    pending.insert(it, event);
+}
+
+
+// fake API
+
+void
+fake_jack_reset(jack_nframes_t buffer_size, jack_nframes_t sample_rate,
+    size_t port_buffer_bytes)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    server.clients.clear();
+    server.ports.clear();
+    server.next_id = 0;
+    server.buffer_size = buffer_size;
+    server.sample_rate = sample_rate;
+    server.port_buffer_bytes = port_buffer_bytes;
+    server.frame = 0;
+    server.loopbacks.clear();
+    server.errors = FakeErrors { 0, 0 };
+}
+
+
+void
+fake_jack_add_device(const char *name, unsigned long flags)
+{
+    jack_port_id_t id;
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        std::string short_name = name;
+        size_t colon = short_name.find(':');
+        if (colon != std::string::npos)
+            short_name = short_name.substr(colon + 1);
+        id = add_port(name, short_name, flags | JackPortIsPhysical, nullptr)
+            ->id;
+    }
+    notify_registration(id);
+}
+
+
+void
+fake_jack_send(const char *port_name, jack_nframes_t offset,
+    const jack_midi_data_t *bytes, size_t size)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    jack_port_t *port = find_port(port_name);
+    if (!port)
+        return;
+    FakeEvent event;
+    event.time = server.frame + offset;
+    event.bytes.assign(bytes, bytes + size);
+    insert_pending(port->pending, event);
+}
+
+
+std::vector<FakeEvent>
+fake_jack_received(const char *port_name)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    std::vector<FakeEvent> events;
+    jack_port_t *port = find_port(port_name);
+    if (port)
+        std::swap(events, port->received);
+    return events;
+}
+
+
+void
+fake_jack_loopback(const char *from, const char *to)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    server.loopbacks.push_back(std::make_pair(from, to));
+}
+
+
+FakeErrors
+fake_jack_errors()
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    return server.errors;
+}
+
+
+// Put pending events due this cycle into a port buffer.
+static void
+fill_buffer(jack_port_t *port, jack_nframes_t start, jack_nframes_t end)
+{
+    PortBuffer &buf = port->buffer;
+    buf.events.clear();
+    buf.used = 0;
+    auto it = port->pending.begin();
+    for (; it != port->pending.end() && it->time < end; ++it) {
+        if (buf.used + it->bytes.size() > buf.data.size()) {
+            buf.lost++;
+            continue;
+        }
+        jack_midi_event_t event;
+        event.time = it->time < start ? 0 : it->time - start;
+        event.size = it->bytes.size();
+        event.buffer = &buf.data[buf.used];
+        memcpy(event.buffer, it->bytes.data(), event.size);
+        buf.used += event.size;
+        buf.events.push_back(event);
+    }
+    port->pending.erase(port->pending.begin(), it);
+}
+
+
+bool
+fake_jack_cycle()
+{
+    std::vector<_jack_client *> clients;
+    jack_nframes_t start, end;
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        start = server.frame;
+        end = start + server.buffer_size;
+        // Route device outputs to the connected client inputs.
+        for (auto &port : server.ports) {
+            if (port->client || !(port->flags & JackPortIsOutput))
+                continue;
+            for (const FakeEvent &event : port->pending) {
+                for (jack_port_t *dest : port->connections)
+                    insert_pending(dest->pending, event);
+            }
+            port->pending.clear();
+        }
+        for (auto &port : server.ports) {
+            if (port->client && (port->flags & JackPortIsInput))
+                fill_buffer(port.get(), start, end);
+        }
+        for (auto &client : server.clients) {
+            if (client->active && client->process)
+                clients.push_back(client.get());
+        }
+    }
+
+    bool ok = true;
+    for (_jack_client *client : clients) {
+        if (client->process(server.buffer_size, client->process_arg) != 0)
+            ok = false;
+    }
+
+    std::lock_guard<std::mutex> guard(server.lock);
+    for (auto &port : server.ports) {
+        if (!port->client || !(port->flags & JackPortIsOutput))
+            continue;
+        for (const jack_midi_event_t &e : port->buffer.events) {
+            FakeEvent event;
+            event.time = start + e.time;
+            event.bytes.assign(e.buffer, e.buffer + e.size);
+            for (jack_port_t *dest : port->connections) {
+                if (dest->client) {
+                    // Client to client arrives on the next cycle.
+                    FakeEvent next = event;
+                    next.time += server.buffer_size;
+                    insert_pending(dest->pending, next);
+                } else {
+                    dest->received.push_back(event);
+                }
+            }
+        }
+    }
+    // Loopbacks also take a cycle.
+    for (const auto &loop : server.loopbacks) {
+        jack_port_t *from = find_port(loop.first.c_str());
+        jack_port_t *to = find_port(loop.second.c_str());
+        if (!from || !to)
+            continue;
+        for (FakeEvent event : from->received) {
+            event.time += server.buffer_size;
+            insert_pending(to->pending, event);
+        }
+        from->received.clear();
+    }
+    server.frame = end;
+    return ok;
+}
+
+
+// jack.h
+
+jack_client_t *
+jack_client_open(const char *client_name, jack_options_t options,
+    jack_status_t *status, ...)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    if (server.buffer_size == 0) {
+        if (status)
+            *status = jack_status_t(JackFailure | JackServerFailed);
+        return nullptr;
+    }
+    std::unique_ptr<_jack_client> client(new _jack_client());
+    client->name = client_name;
+    client->active = false;
+    client->process = nullptr;
+    client->registration = nullptr;
+    server.clients.push_back(std::move(client));
+    if (status)
+        *status = jack_status_t(0);
+    return server.clients.back().get();
+}
+
+int
+jack_client_close(jack_client_t *client)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    auto &ports = server.ports;
+    for (auto &port : ports) {
+        auto &conns = port->connections;
+        conns.erase(std::remove_if(conns.begin(), conns.end(),
+            [client](jack_port_t *p) { return p->client == client; }),
+            conns.end());
+    }
+    ports.erase(std::remove_if(ports.begin(), ports.end(),
+        [client](const std::unique_ptr<_jack_port> &p) {
+            return p->client == client;
+        }), ports.end());
+    auto &clients = server.clients;
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+        [client](const std::unique_ptr<_jack_client> &c) {
+            return c.get() == client;
+        }), clients.end());
+    return 0;
+}
+
+char *
+jack_get_client_name(jack_client_t *client)
+{
+    return const_cast<char *>(client->name.c_str());
+}
+
+int
+jack_activate(jack_client_t *client)
+{
+    client->active = true;
+    return 0;
+}
+
+int
+jack_set_process_callback(
+    jack_client_t *client, JackProcessCallback callback, void *arg)
+{
+    client->process = callback;
+    client->process_arg = arg;
+    return 0;
+}
+
+int
+jack_set_port_registration_callback(
+    jack_client_t *client, JackPortRegistrationCallback callback, void *arg)
+{
+    client->registration = callback;
+    client->registration_arg = arg;
+    return 0;
+}
+
+int
+jack_set_port_connect_callback(
+    jack_client_t *client, JackPortConnectCallback callback, void *arg)
+{
+    return 0;
+}
+
+jack_port_t *
+jack_port_register(jack_client_t *client, const char *port_name,
+    const char *port_type, unsigned long flags, unsigned long buffer_size)
+{
+    jack_port_t *port;
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        std::string name = client->name + ":" + port_name;
+        if (find_port(name.c_str()))
+            return nullptr;
+        port = add_port(name, port_name, flags, client);
+    }
+    notify_registration(port->id);
+    return port;
+}
+
+jack_port_t *
+jack_port_by_name(jack_client_t *client, const char *port_name)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    return find_port(port_name);
+}
+
+jack_port_t *
+jack_port_by_id(jack_client_t *client, jack_port_id_t port_id)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    for (auto &port : server.ports) {
+        if (port->id == port_id)
+            return port.get();
+    }
+    return nullptr;
+}
+
+const char *
+jack_port_name(const jack_port_t *port)
+{
+    return port->name.c_str();
+}
+
+const char *
+jack_port_short_name(const jack_port_t *port)
+{
+    return port->short_name.c_str();
+}
+
+int
+jack_port_flags(const jack_port_t *port)
+{
+    return port->flags;
+}
+
+int
+jack_port_name_size()
+{
+    return 320;
+}
+
+int
+jack_port_get_aliases(const jack_port_t *port, char * const aliases[2])
+{
+    return 0;
+}
+
+// Like JACK, an input port with a single connection shares the buffer of
+// the output port connected to it.  jack.cc relies on this, since it writes
+// to the remote port.
+void *
+jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes)
+{
+    if (port->flags & JackPortIsInput) {
+        std::lock_guard<std::mutex> guard(server.lock);
+        jack_port_t *source = nullptr;
+        int sources = 0;
+        for (auto &p : server.ports) {
+            if (std::find(p->connections.begin(), p->connections.end(), port)
+                    != p->connections.end()) {
+                source = p.get();
+                sources++;
+            }
+        }
+        // External ports don't have real buffers, their events are copied
+        // into the input port's by fake_jack_cycle.
+        if (sources == 1 && source->client)
+            return &source->buffer;
+    }
+    return &port->buffer;
+}
+
+int
+jack_connect(jack_client_t *client, const char *source_port,
+    const char *destination_port)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    jack_port_t *src = find_port(source_port);
+    jack_port_t *dest = find_port(destination_port);
+    if (!src || !dest || !(src->flags & JackPortIsOutput)
+            || !(dest->flags & JackPortIsInput))
+        return 1;
+    if (std::find(src->connections.begin(), src->connections.end(), dest)
+            == src->connections.end())
+        src->connections.push_back(dest);
+    return 0;
+}
+
+int
+jack_port_disconnect(jack_client_t *client, jack_port_t *port)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    port->connections.clear();
+    for (auto &p : server.ports) {
+        auto &conns = p->connections;
+        conns.erase(std::remove(conns.begin(), conns.end(), port),
+            conns.end());
+    }
+    return 0;
+}
+
+const char **
+jack_get_ports(jack_client_t *client, const char *port_name_pattern,
+    const char *type_name_pattern, unsigned long flags)
+{
+    std::lock_guard<std::mutex> guard(server.lock);
+    std::vector<const char *> names;
+    for (auto &port : server.ports) {
+        if ((port->flags & flags) == flags)
+            names.push_back(port->name.c_str());
+    }
+    if (names.empty())
+        return nullptr;
+    const char **array = static_cast<const char **>(
+        calloc(names.size() + 1, sizeof(char *)));
+    std::copy(names.begin(), names.end(), array);
+    return array;
+}
+
+jack_nframes_t
+jack_get_sample_rate(jack_client_t *client)
+{
+    return server.sample_rate;
+}
+
+jack_nframes_t
+jack_frame_time(const jack_client_t *client)
+{
+    return server.frame;
+}
+
+jack_nframes_t
+jack_last_frame_time(const jack_client_t *client)
+{
+    return server.frame;
+}
+
+jack_time_t
+jack_frames_to_time(const jack_client_t *client, jack_nframes_t frames)
+{
+    return (jack_time_t(frames) * 1000000 + server.sample_rate / 2)
+        / server.sample_rate;
+}
+
+jack_nframes_t
+jack_time_to_frames(const jack_client_t *client, jack_time_t time)
+{
+    return (time * server.sample_rate + 500000) / 1000000;
+}
+
+
+// midiport.h
+
+static PortBuffer *
+port_buffer(void *buf)
+{
+    return static_cast<PortBuffer *>(buf);
+}
+
+uint32_t
+jack_midi_get_event_count(void *port_buffer_)
+{
+    return port_buffer(port_buffer_)->events.size();
+}
+
+int
+jack_midi_event_get(jack_midi_event_t *event, void *port_buffer_,
+    uint32_t event_index)
+{
+    PortBuffer *buf = port_buffer(port_buffer_);
+    if (event_index >= buf->events.size())
+        return -1;
+    *event = buf->events[event_index];
+    return 0;
+}
+
+void
+jack_midi_clear_buffer(void *port_buffer_)
+{
+    PortBuffer *buf = port_buffer(port_buffer_);
+    buf->events.clear();
+    buf->used = 0;
+}
+
+size_t
+jack_midi_max_event_size(void *port_buffer_)
+{
+    PortBuffer *buf = port_buffer(port_buffer_);
+    return buf->data.size() - buf->used;
+}
+
+jack_midi_data_t *
+jack_midi_event_reserve(void *port_buffer_, jack_nframes_t time,
+    size_t data_size)
+{
+    PortBuffer *buf = port_buffer(port_buffer_);
+    // Like JACK, events must be written in time order.
+    if (time >= server.buffer_size
+            || (!buf->events.empty() && time < buf->events.back().time)) {
+        server.errors.misordered++;
+        buf->lost++;
+        return nullptr;
+    }
+    if (buf->used + data_size > buf->data.size()) {
+        server.errors.overflowed++;
+        buf->lost++;
+        return nullptr;
+    }
+    jack_midi_event_t event;
+    event.time = time;
+    event.size = data_size;
+    event.buffer = &buf->data[buf->used];
+    buf->used += data_size;
+    buf->events.push_back(event);
+    return event.buffer;
+}
+
+int
+jack_midi_event_write(void *port_buffer_, jack_nframes_t time,
+    const jack_midi_data_t *data, size_t data_size)
+{
+    jack_midi_data_t *dest =
+        jack_midi_event_reserve(port_buffer_, time, data_size);
+    if (!dest)
+        return ENOBUFS;
+    memcpy(dest, data, data_size);
+    return 0;
+}
+
+uint32_t
+jack_midi_get_lost_event_count(void *port_buffer_)
+{
+    return port_buffer(port_buffer_)->lost;
+}
+
+
+// ringbuffer.h
+//
+// This is the usual single reader single writer ringbuffer, with the size
+// rounded up to a power of 2, and one byte always left empty.
+
+jack_ringbuffer_t *
+jack_ringbuffer_create(size_t sz)
+{
+    size_t size = 1;
+    while (size < sz)
+        size <<= 1;
+    jack_ringbuffer_t *rb = new jack_ringbuffer_t;
+    rb->buf = new char[size];
+    rb->size = size;
+    rb->size_mask = size - 1;
+    rb->write_ptr = 0;
+    rb->read_ptr = 0;
+    rb->mlocked = 0;
+    return rb;
+}
+
+void
+jack_ringbuffer_free(jack_ringbuffer_t *rb)
+{
+    delete[] rb->buf;
+    delete rb;
+}
+
+int
+jack_ringbuffer_mlock(jack_ringbuffer_t *rb)
+{
+    rb->mlocked = 1;
+    return 0;
+}
+
+static size_t
+load(const volatile size_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void
+store(volatile size_t *p, size_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+size_t
+jack_ringbuffer_read_space(const jack_ringbuffer_t *rb)
+{
+    size_t w = load(&rb->write_ptr), r = load(&rb->read_ptr);
+    return (w - r) & rb->size_mask;
+}
+
+size_t
+jack_ringbuffer_write_space(const jack_ringbuffer_t *rb)
+{
+    size_t w = load(&rb->write_ptr), r = load(&rb->read_ptr);
+    return (r - w - 1) & rb->size_mask;
+}
+
+size_t
+jack_ringbuffer_peek(jack_ringbuffer_t *rb, char *dest, size_t cnt)
+{
+    size_t n = std::min(cnt, jack_ringbuffer_read_space(rb));
+    size_t r = load(&rb->read_ptr);
+    for (size_t i = 0; i < n; i++)
+        dest[i] = rb->buf[(r + i) & rb->size_mask];
+    return n;
+}
+
+size_t
+jack_ringbuffer_read(jack_ringbuffer_t *rb, char *dest, size_t cnt)
+{
+    size_t n = jack_ringbuffer_peek(rb, dest, cnt);
+    jack_ringbuffer_read_advance(rb, n);
+    return n;
+}
+
+size_t
+jack_ringbuffer_write(jack_ringbuffer_t *rb, const char *src, size_t cnt)
+{
+    size_t n = std::min(cnt, jack_ringbuffer_write_space(rb));
+    size_t w = load(&rb->write_ptr);
+    for (size_t i = 0; i < n; i++)
+        rb->buf[(w + i) & rb->size_mask] = src[i];
+    jack_ringbuffer_write_advance(rb, n);
+    return n;
+}
+
+void
+jack_ringbuffer_read_advance(jack_ringbuffer_t *rb, size_t cnt)
+{
+    store(&rb->read_ptr, (load(&rb->read_ptr) + cnt) & rb->size_mask);
+}
+
+void
+jack_ringbuffer_write_advance(jack_ringbuffer_t *rb, size_t cnt)
+{
+    store(&rb->write_ptr, (load(&rb->write_ptr) + cnt) & rb->size_mask);
+}
+
+void
+jack_ringbuffer_get_read_vector(
+    const jack_ringbuffer_t *rb, jack_ringbuffer_data_t *vec)
+{
+    size_t r = load(&rb->read_ptr);
+    size_t n = jack_ringbuffer_read_space(rb);
+    size_t first = std::min(n, rb->size - r);
+    vec[0].buf = rb->buf + r;
+    vec[0].len = first;
+    vec[1].buf = rb->buf;
+    vec[1].len = n - first;
+}
+
+void
+jack_ringbuffer_get_write_vector(
+    const jack_ringbuffer_t *rb, jack_ringbuffer_data_t *vec)
+{
+    size_t w = load(&rb->write_ptr);
+    size_t n = jack_ringbuffer_write_space(rb);
+    size_t first = std::min(n, rb->size - w);
+    vec[0].buf = rb->buf + w;
+    vec[0].len = first;
+    vec[1].buf = rb->buf;
+    vec[1].len = n - first;
+}
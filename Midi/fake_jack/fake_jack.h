@@ -0,0 +1,57 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// An in-process stand-in for the JACK server.
+//
+// This implements the subset of the JACK API that Midi/jack.cc uses, so it
+// can be tested without a running server.  Nothing happens on its own:
+// the test calls fake_jack_cycle to run the client's process callback, and
+// the simulated clock advances by one buffer each time.  External ports stand
+// in for MIDI devices.
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "jack/jack.h"
+#include "jack/midiport.h"
+
+
+struct FakeEvent {
+    // Absolute frame time.
+    jack_nframes_t time;
+    std::vector<jack_midi_data_t> bytes;
+};
+
+// Forget all clients and ports, and reset the clock to 0.
+void fake_jack_reset(jack_nframes_t buffer_size = 256,
+    jack_nframes_t sample_rate = 44100, size_t port_buffer_bytes = 32 * 1024);
+
+// Create an external port, as if a MIDI device appeared.  JackPortIsOutput
+// ports send to karya, JackPortIsInput ones receive from it.
+void fake_jack_add_device(const char *name, unsigned long flags);
+
+// Queue an event to arrive on an external output port on the next cycle, at
+// the given frame offset in that cycle.
+void fake_jack_send(const char *port, jack_nframes_t offset,
+    const jack_midi_data_t *bytes, size_t size);
+
+// Everything received by an external input port since the last call.
+std::vector<FakeEvent> fake_jack_received(const char *port);
+
+// Anything received by external input port 'from' is sent from external
+// output port 'to' on the next cycle, like a MIDI cable plugged into itself.
+void fake_jack_loopback(const char *from, const char *to);
+
+// Run one process cycle for every activated client, and advance the clock.
+// Return false if a process callback returned an error.
+bool fake_jack_cycle();
+
+// Events the client tried to write out of time order, or that didn't fit in
+// the port buffer.  JACK drops these.
+struct FakeErrors {
+    int misordered;
+    int overflowed;
+};
+FakeErrors fake_jack_errors();
@@ -0,0 +1,58 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// The subset of the JACK client API used by Midi/jack.cc.  See fake_jack.h.
+#pragma once
+
+#include "jack/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+jack_client_t *jack_client_open(
+    const char *client_name, jack_options_t options, jack_status_t *status,
+    ...);
+int jack_client_close(jack_client_t *client);
+char *jack_get_client_name(jack_client_t *client);
+int jack_activate(jack_client_t *client);
+
+int jack_set_process_callback(
+    jack_client_t *client, JackProcessCallback callback, void *arg);
+int jack_set_port_registration_callback(
+    jack_client_t *client, JackPortRegistrationCallback callback, void *arg);
+int jack_set_port_connect_callback(
+    jack_client_t *client, JackPortConnectCallback callback, void *arg);
+
+jack_port_t *jack_port_register(
+    jack_client_t *client, const char *port_name, const char *port_type,
+    unsigned long flags, unsigned long buffer_size);
+jack_port_t *jack_port_by_name(jack_client_t *client, const char *port_name);
+jack_port_t *jack_port_by_id(jack_client_t *client, jack_port_id_t port_id);
+const char *jack_port_name(const jack_port_t *port);
+const char *jack_port_short_name(const jack_port_t *port);
+int jack_port_flags(const jack_port_t *port);
+int jack_port_name_size(void);
+int jack_port_get_aliases(const jack_port_t *port, char * const aliases[2]);
+void *jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes);
+
+int jack_connect(
+    jack_client_t *client, const char *source_port,
+    const char *destination_port);
+int jack_port_disconnect(jack_client_t *client, jack_port_t *port);
+const char **jack_get_ports(
+    jack_client_t *client, const char *port_name_pattern,
+    const char *type_name_pattern, unsigned long flags);
+
+jack_nframes_t jack_get_sample_rate(jack_client_t *client);
+jack_nframes_t jack_frame_time(const jack_client_t *client);
+jack_nframes_t jack_last_frame_time(const jack_client_t *client);
+jack_time_t jack_frames_to_time(
+    const jack_client_t *client, jack_nframes_t frames);
+jack_nframes_t jack_time_to_frames(
+    const jack_client_t *client, jack_time_t time);
+
+#ifdef __cplusplus
+}
+#endif
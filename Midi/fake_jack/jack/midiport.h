@@ -0,0 +1,36 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// The subset of the JACK MIDI API used by Midi/jack.cc.  See fake_jack.h.
+#pragma once
+
+#include "jack/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned char jack_midi_data_t;
+
+typedef struct _jack_midi_event {
+    jack_nframes_t time;
+    size_t size;
+    jack_midi_data_t *buffer;
+} jack_midi_event_t;
+
+uint32_t jack_midi_get_event_count(void *port_buffer);
+int jack_midi_event_get(
+    jack_midi_event_t *event, void *port_buffer, uint32_t event_index);
+void jack_midi_clear_buffer(void *port_buffer);
+size_t jack_midi_max_event_size(void *port_buffer);
+jack_midi_data_t *jack_midi_event_reserve(
+    void *port_buffer, jack_nframes_t time, size_t data_size);
+int jack_midi_event_write(
+    void *port_buffer, jack_nframes_t time, const jack_midi_data_t *data,
+    size_t data_size);
+uint32_t jack_midi_get_lost_event_count(void *port_buffer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,46 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// The JACK ringbuffer API used by Midi/jack.cc.  See fake_jack.h.
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    char *buf;
+    size_t len;
+} jack_ringbuffer_data_t;
+
+typedef struct {
+    char *buf;
+    volatile size_t write_ptr;
+    volatile size_t read_ptr;
+    size_t size;
+    size_t size_mask;
+    int mlocked;
+} jack_ringbuffer_t;
+
+jack_ringbuffer_t *jack_ringbuffer_create(size_t sz);
+void jack_ringbuffer_free(jack_ringbuffer_t *rb);
+int jack_ringbuffer_mlock(jack_ringbuffer_t *rb);
+size_t jack_ringbuffer_read_space(const jack_ringbuffer_t *rb);
+size_t jack_ringbuffer_write_space(const jack_ringbuffer_t *rb);
+size_t jack_ringbuffer_read(jack_ringbuffer_t *rb, char *dest, size_t cnt);
+size_t jack_ringbuffer_peek(jack_ringbuffer_t *rb, char *dest, size_t cnt);
+size_t jack_ringbuffer_write(
+    jack_ringbuffer_t *rb, const char *src, size_t cnt);
+void jack_ringbuffer_read_advance(jack_ringbuffer_t *rb, size_t cnt);
+void jack_ringbuffer_write_advance(jack_ringbuffer_t *rb, size_t cnt);
+void jack_ringbuffer_get_read_vector(
+    const jack_ringbuffer_t *rb, jack_ringbuffer_data_t *vec);
+void jack_ringbuffer_get_write_vector(
+    const jack_ringbuffer_t *rb, jack_ringbuffer_data_t *vec);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,53 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// The subset of JACK types used by Midi/jack.cc.  See fake_jack.h.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t jack_nframes_t;
+typedef uint64_t jack_time_t;
+typedef uint32_t jack_port_id_t;
+
+typedef struct _jack_client jack_client_t;
+typedef struct _jack_port jack_port_t;
+
+enum JackOptions {
+    JackNullOption = 0x00,
+    JackNoStartServer = 0x01,
+};
+typedef enum JackOptions jack_options_t;
+
+enum JackStatus {
+    JackFailure = 0x01,
+    JackInvalidOption = 0x02,
+    JackNameNotUnique = 0x04,
+    JackServerStarted = 0x08,
+    JackServerFailed = 0x10,
+    JackServerError = 0x20,
+    JackNoSuchClient = 0x40,
+    JackLoadFailure = 0x80,
+    JackInitFailure = 0x100,
+    JackShmFailure = 0x200,
+    JackVersionError = 0x400,
+};
+typedef enum JackStatus jack_status_t;
+
+enum JackPortFlags {
+    JackPortIsInput = 0x1,
+    JackPortIsOutput = 0x2,
+    JackPortIsPhysical = 0x4,
+    JackPortCanMonitor = 0x8,
+    JackPortIsTerminal = 0x10,
+};
+
+#define JACK_DEFAULT_MIDI_TYPE "8 bit raw midi"
+
+typedef int (*JackProcessCallback)(jack_nframes_t nframes, void *arg);
+typedef void (*JackPortRegistrationCallback)(
+    jack_port_id_t port, int is_register, void *arg);
+typedef void (*JackPortConnectCallback)(
+    jack_port_id_t a, jack_port_id_t b, int connect, void *arg);
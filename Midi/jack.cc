@@ -3,7 +3,12 @@
 // License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
 
 // Binding to the MIDI part of JACK.
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
 #include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "jack.h"
 
 // just for DEBUG
@@ -12,54 +17,137 @@
 
 // create_client
 
-Client::Client()
+Client::Client() : read_ports(new port_list()),
+    write_ports(new port_list()), routes(new route_list()), cycles(0),
+    output(output_queue_size), garbage(garbage_size), next_seq(0),
+    abort_generation(0), generation(0), aborted(false),
+    written(0), late(0), late_max(0), late_total(0), dropped(0), overruns(0)
 {
-    for (int i = 0; i < MAX_PORTS; i++) {
-        read_ports[i] = 0;
-        write_ports[i] = 0;
-    }
-    sem_init(&available, 0, 0);
+    input_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
     // TODO memset(ring->buf, 0, ring->size) to avoid page faults?
-    // failed = jack_ringbuffer_mlock(client.immediate_output_ring);
-    immediate_output = jack_ringbuffer_create(immediate_output_buffer_size);
-    output = jack_ringbuffer_create(output_buffer_size);
     input = jack_ringbuffer_create(input_buffer_size);
+    schedule.reserve(schedule_size);
+    streams.reserve(max_streams);
+    deferred.reserve(schedule_size);
+    thru.reserve(thru_size);
+    probe.running.store(false);
 }
 
 Client::~Client()
 {
-    sem_destroy(&available);
-    jack_ringbuffer_free(immediate_output);
-    jack_ringbuffer_free(output);
+    if (input_fd >= 0)
+        close(input_fd);
     jack_ringbuffer_free(input);
+    collect_garbage();
+    // Anything left on the queue or schedule was never sent back.
+    output_event event;
+    while (output.pop(&event))
+        release(event);
+    for (const output_event &event : schedule)
+        release(event);
+    for (const sysex_stream &stream : streams)
+        release(stream.event);
+    collect_garbage();
+    delete read_ports.load();
+    delete write_ports.load();
+    delete routes.load();
+    for (const auto &list : retired)
+        delete list.first;
+    for (const auto &list : retired_routes)
+        delete list.first;
+}
+
+void
+Client::release(const output_event &event)
+{
+    if (event.size > inline_bytes && !garbage.push(event.large))
+        DEBUG("garbage queue overflow, leaked " << event.size << " bytes");
+}
+
+void
+Client::collect_garbage()
+{
+    jack_midi_data_t *bytes;
+    while (garbage.pop(&bytes))
+        delete[] bytes;
 }
 
 void
 Client::add_read_port(jack_port_t *port)
 {
-    for (int i = 0; i < MAX_PORTS; i++) {
-        if (__sync_bool_compare_and_swap(&read_ports[i], 0, port))
-            break;
-    }
+    update_ports(read_ports, port, true);
 }
 
 void
 Client::remove_read_port(jack_port_t *port)
 {
-    for (int i = 0; i < MAX_PORTS; i++) {
-        if (__sync_bool_compare_and_swap(&read_ports[i], port, 0))
-            break;
-    }
+    update_ports(read_ports, port, false);
 }
 
 void
 Client::add_write_port(jack_port_t *port)
 {
-    for (int i = 0; i < MAX_PORTS; i++) {
-        if (__sync_bool_compare_and_swap(&write_ports[i], 0, port))
-            break;
-    }
+    update_ports(write_ports, port, true);
+}
+
+// Replace the list with a copy that has the port added or removed.
+// process() may still be using the old one, so it's retired rather than
+// deleted.
+void
+Client::update_ports(std::atomic<const port_list *> &list,
+    jack_port_t *port, bool add)
+{
+    std::lock_guard<std::mutex> guard(ports_lock);
+    const port_list *old = list.load();
+    auto found = std::find(old->begin(), old->end(), port);
+    if (add == (found != old->end()))
+        return;
+    port_list *ports = new port_list(*old);
+    if (add)
+        ports->push_back(port);
+    else
+        ports->erase(ports->begin() + (found - old->begin()));
+    list.store(ports);
+    retired.push_back(std::make_pair(old, cycles.load()));
+    reclaim_ports();
+}
+
+// Replace the routes.  Like update_ports, the old list is retired.
+void
+Client::set_routes(const route_list *new_routes)
+{
+    std::lock_guard<std::mutex> guard(ports_lock);
+    const route_list *old = routes.load();
+    routes.store(new_routes);
+    retired_routes.push_back(std::make_pair(old, cycles.load()));
+    reclaim_ports();
+}
+
+// Delete retired lists that process() can't be using any more.  If it was
+// running when a list was replaced, it will have finished by the time
+// 'cycles' changes, and later cycles will see the new list.
+void
+Client::reclaim_ports()
+{
+    uint64_t now = cycles.load();
+    auto end = std::remove_if(retired.begin(), retired.end(),
+        [now](const std::pair<const port_list *, uint64_t> &list) {
+            if (list.second == now)
+                return false;
+            delete list.first;
+            return true;
+        });
+    retired.erase(end, retired.end());
+    auto routes_end = std::remove_if(
+        retired_routes.begin(), retired_routes.end(),
+        [now](const std::pair<const route_list *, uint64_t> &list) {
+            if (list.second == now)
+                return false;
+            delete list.first;
+            return true;
+        });
+    retired_routes.erase(routes_end, retired_routes.end());
 }
 
 
@@ -89,24 +177,389 @@ port_connect_callback(jack_port_id_t a, jack_port_id_t b, int connect,
 }
 
 
-static void
-write_midi_event(jack_nframes_t nframes, const midi_event &event)
+static bool
+is_sysex(const output_event &event)
+{
+    return event.size > 0 && event.data()[0] == 0xf0;
+}
+
+
+// Write the event, starting from byte 'sent'.  A sysex may be only partially
+// written, depending on space in the port buffer.  Return the number of bytes
+// written, which is 0 if there was no room.
+static uint32_t
+write_midi_event(Client *client, jack_nframes_t nframes,
+    jack_nframes_t offset, const output_event &event, uint32_t sent)
 {
     void *buf = jack_port_get_buffer(event.port, nframes);
     if (!buf) {
         DEBUG("port has no buffer");
-        return;
+        return 0;
+    }
+    uint32_t size = event.size - sent;
+    if (is_sysex(event)) {
+        size = std::min(size, uint32_t(sysex_fragment_bytes));
+        size = std::min(size, uint32_t(jack_midi_max_event_size(buf)));
+        if (size == 0)
+            return 0;
     }
-    jack_midi_data_t *midi = jack_midi_event_reserve(
-        buf, event.event.time, event.event.size);
+    jack_midi_data_t *midi = jack_midi_event_reserve(buf, offset, size);
     if (!midi) {
         DEBUG("no space in output port " << event.port);
+        client->dropped.fetch_add(1, std::memory_order_relaxed);
+        return 0;
     } else {
         // DEBUG("write event on " <<  event.port);
-        memcpy(midi, event.event.buffer, event.event.size);
+        memcpy(midi, event.data() + sent, size);
+        if (sent + size == event.size)
+            client->written.fetch_add(1, std::memory_order_relaxed);
+        return size;
+    }
+}
+
+
+static bool
+is_streaming(const Client *client, const jack_port_t *port)
+{
+    for (const sysex_stream &stream : client->streams) {
+        if (stream.event.port == port)
+            return true;
+    }
+    return false;
+}
+
+
+// Order for the schedule heap.  Since it's a max heap, this returns true if
+// 'a' should go out after 'b'.  Immediate events go first, then by time,
+// and events with the same time go in the order they were written.  Frame
+// times wrap, so compare them by difference.  The seq also wraps, but it
+// would take 4 billion events at the same time for that to matter.
+static bool
+later(const output_event &a, const output_event &b)
+{
+    if (a.immediate != b.immediate)
+        return b.immediate;
+    if (!a.immediate && a.time != b.time)
+        return int32_t(a.time - b.time) > 0;
+    return int32_t(a.seq - b.seq) > 0;
+}
+
+
+static void
+record_late(Client *client, jack_nframes_t frames)
+{
+    client->late.fetch_add(1, std::memory_order_relaxed);
+    client->late_total.fetch_add(frames, std::memory_order_relaxed);
+    // Only process() writes late_max, except for reset.
+    if (frames > client->late_max.load(std::memory_order_relaxed))
+        client->late_max.store(frames, std::memory_order_relaxed);
+}
+
+
+// If there has been an abort, discard the schedule.  Return false if the
+// generation is older than the current one.
+static bool
+new_generation(Client *client, uint32_t generation)
+{
+    int32_t delta = int32_t(generation - client->generation);
+    if (delta > 0) {
+        for (const output_event &event : client->schedule)
+            client->release(event);
+        client->schedule.clear();
+        for (const sysex_stream &stream : client->streams)
+            client->release(stream.event);
+        client->streams.clear();
+        client->generation = generation;
+        client->aborted = true;
+    }
+    return delta >= 0;
+}
+
+
+// Silence everything after an abort.  This goes at the start of the cycle,
+// before anything written since the abort.  If a sysex was cut off, the
+// status bytes end it.
+static void
+write_silence(Client *client, const port_list &write_ports,
+    jack_nframes_t nframes)
+{
+    for (jack_port_t *port : write_ports) {
+        void *buf = jack_port_get_buffer(port, nframes);
+        for (jack_midi_data_t chan = 0; chan < 16; chan++) {
+            // All notes off, then reset all controllers.
+            const jack_midi_data_t msgs[2][3] = {
+                { jack_midi_data_t(0xb0 | chan), 123, 0 },
+                { jack_midi_data_t(0xb0 | chan), 121, 0 }
+            };
+            for (const jack_midi_data_t *msg : msgs) {
+                if (jack_midi_event_write(buf, 0, msg, 3) != 0)
+                    client->dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+
+// Continue sysexes which didn't fit in previous cycles.  They go at the
+// start of the cycle, before anything else on their ports.
+static void
+write_streams(Client *client, jack_nframes_t nframes)
+{
+    std::vector<sysex_stream> &streams = client->streams;
+    for (size_t i = 0; i < streams.size();) {
+        sysex_stream &stream = streams[i];
+        stream.sent += write_midi_event(
+            client, nframes, 0, stream.event, stream.sent);
+        if (stream.sent == stream.event.size) {
+            client->release(stream.event);
+            stream = streams.back();
+            streams.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+
+// Write all scheduled events which fall in this cycle.  Since they come out
+// of the heap in time order, each port's events are also in time order, as
+// jack_midi_event_reserve requires.
+//
+// A sysex that doesn't fit in the port buffer, or is longer than
+// sysex_fragment_bytes, is written in fragments over several cycles.  Since
+// nothing else may be sent in the middle of a sysex, other events for its
+// port wait until it's done.
+static void
+write_output(Client *client, const port_list &write_ports,
+    jack_nframes_t now, jack_nframes_t nframes)
+{
+    std::vector<output_event> &schedule = client->schedule;
+    new_generation(client, client->abort_generation.load());
+    // Move new events to the schedule.  If it's full, they have to wait in
+    // the queue.
+    output_event event;
+    while (schedule.size() < schedule_size && client->output.pop(&event)) {
+        // An abort may have happened since I checked above.
+        if (!new_generation(client, event.generation)) {
+            client->release(event);
+            continue;
+        }
+        event.seq = client->next_seq++;
+        schedule.push_back(event);
+        std::push_heap(schedule.begin(), schedule.end(), later);
+    }
+    // Thru from this cycle's input.  It gets the current generation, since
+    // it arrived after any abort process() has seen.
+    for (output_event &event : client->thru) {
+        if (schedule.size() == schedule_size) {
+            client->dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        event.generation = client->generation;
+        event.seq = client->next_seq++;
+        schedule.push_back(event);
+        std::push_heap(schedule.begin(), schedule.end(), later);
+    }
+    client->thru.clear();
+    if (client->aborted) {
+        write_silence(client, write_ports, nframes);
+        client->aborted = false;
+    }
+    write_streams(client, nframes);
+    while (!schedule.empty()) {
+        const output_event &next = schedule.front();
+        jack_nframes_t offset = 0;
+        int32_t delta = int32_t(next.time - now);
+        if (!next.immediate && delta >= int32_t(nframes))
+            break;
+        if (is_streaming(client, next.port)
+            || (is_sysex(next) && client->streams.size() == max_streams))
+        {
+            client->deferred.push_back(next);
+        } else {
+            if (!next.immediate) {
+                if (delta < 0)
+                    record_late(client, -delta);
+                else
+                    offset = delta;
+            }
+            uint32_t sent = write_midi_event(client, nframes, offset, next, 0);
+            if (is_sysex(next) && sent < next.size) {
+                sysex_stream stream = { next, sent };
+                client->streams.push_back(stream);
+            } else {
+                client->release(next);
+            }
+        }
+        std::pop_heap(schedule.begin(), schedule.end(), later);
+        schedule.pop_back();
+    }
+    for (const output_event &event : client->deferred) {
+        schedule.push_back(event);
+        std::push_heap(schedule.begin(), schedule.end(), later);
+    }
+    client->deferred.clear();
+}
+
+
+// Copy an incoming channel message to the write ports routed from its port.
+// They go out at the same time they came in, so they wind up at the same
+// offset in this cycle.
+static void
+route_thru(Client *client, const route_list &routes, jack_port_t *port,
+    jack_nframes_t time, const jack_midi_data_t *bytes, size_t size)
+{
+    if (size == 0 || size > 3 || bytes[0] < 0x80 || bytes[0] >= 0xf0)
+        return;
+    int chan = bytes[0] & 0x0f;
+    for (const thru_route &route : routes) {
+        if (route.from != port || !(route.channels & (1 << chan)))
+            continue;
+        if (client->thru.size() == thru_size) {
+            client->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        output_event event;
+        event.port = route.to;
+        event.time = time;
+        event.size = size;
+        event.immediate = false;
+        event.generation = 0;
+        event.seq = 0;
+        memcpy(event.bytes, bytes, size);
+        if (route.channel >= 0)
+            event.bytes[0] = (bytes[0] & 0xf0) | route.channel;
+        client->thru.push_back(event);
+    }
+}
+
+
+// Put an incoming message on the input ringbuffer.  Return false if there
+// was no room for it.
+static bool
+write_input(Client *client, jack_port_t *port, jack_nframes_t time,
+    const jack_midi_data_t *bytes, size_t size)
+{
+    // A sysex may arrive in pieces.  read_events puts them back together.
+    bool unterminated = size > 0 && (bytes[0] == 0xf0 || bytes[0] < 0x80)
+        && bytes[size - 1] != 0xf7;
+    size_t start = 0;
+    do {
+        input_header header;
+        header.port = port;
+        header.time = time;
+        header.size = std::min(size - start, size_t(input_chunk_bytes));
+        header.more = start + header.size < size || unterminated;
+        if (jack_ringbuffer_write_space(client->input)
+                < sizeof(header) + header.size)
+        {
+            DEBUG("input buffer overrun");
+            return start > 0;
+        }
+        jack_ringbuffer_write(client->input, (char *) &header, sizeof(header));
+        jack_ringbuffer_write(
+            client->input, (char *) bytes + start, header.size);
+        start += header.size;
+    } while (start < size);
+    return true;
+}
+
+// latency probe
+
+// A probe is a sysex with the non-commercial ID: F0 7D 'k' seq_hi seq_lo F7.
+enum { probe_size = 6, probe_seq_mask = 0x3fff };
+
+static bool
+is_probe(const jack_midi_data_t *bytes, size_t size)
+{
+    return size == probe_size && bytes[0] == 0xf0 && bytes[1] == 0x7d
+        && bytes[2] == 'k' && bytes[5] == 0xf7;
+}
+
+static void
+add_bucket(std::atomic<uint32_t> *buckets, int count, uint64_t n)
+{
+    buckets[std::min(n, uint64_t(count - 1))].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+// A probe came back, so record its round trip.
+static void
+receive_probe(latency_probe &probe, jack_nframes_t time,
+    const jack_midi_data_t *bytes)
+{
+    uint32_t seq = (bytes[3] << 7) | bytes[4];
+    uint32_t slot = seq % probe_slots;
+    if (!probe.pending[slot] || (probe.seqs[slot] & probe_seq_mask) != seq)
+        return;
+    probe.pending[slot] = false;
+    jack_nframes_t trip = time - probe.sent_at[slot];
+    probe.received.fetch_add(1, std::memory_order_relaxed);
+    probe.total.fetch_add(trip, std::memory_order_relaxed);
+    if (trip < probe.min.load(std::memory_order_relaxed))
+        probe.min.store(trip, std::memory_order_relaxed);
+    if (trip > probe.max.load(std::memory_order_relaxed))
+        probe.max.store(trip, std::memory_order_relaxed);
+    uint64_t us = uint64_t(trip) * 1000000 / probe.srate;
+    add_bucket(probe.latency, latency_buckets, us / latency_bucket_us);
+    if (probe.have_last) {
+        jack_nframes_t diff = trip > probe.last_trip
+            ? trip - probe.last_trip : probe.last_trip - trip;
+        us = uint64_t(diff) * 1000000 / probe.srate;
+        add_bucket(probe.jitter, jitter_buckets, us / jitter_bucket_us);
+    }
+    probe.last_trip = trip;
+    probe.have_last = true;
+}
+
+// Send the next probe if it's due.  It goes at the start of the cycle, so it
+// can't get out of order with the events write_output puts after it.
+static void
+send_probe(Client *client, jack_nframes_t now, jack_nframes_t nframes)
+{
+    latency_probe &probe = client->probe;
+    if (!probe.started) {
+        probe.started = true;
+        probe.next_send = now;
+    }
+    if (probe.next_seq == probe.count) {
+        // Wait a second for stragglers, then give up on them.
+        bool waiting = false;
+        for (bool pending : probe.pending)
+            waiting |= pending;
+        if (waiting && int32_t(now - probe.next_send) < int32_t(probe.srate))
+            return;
+        for (bool &pending : probe.pending) {
+            if (pending)
+                probe.lost.fetch_add(1, std::memory_order_relaxed);
+            pending = false;
+        }
+        probe.running.store(false, std::memory_order_release);
+        return;
     }
+    // Don't interrupt a sysex.
+    if (int32_t(probe.next_send - now) >= int32_t(nframes)
+            || is_streaming(client, probe.write_port))
+        return;
+    uint32_t slot = probe.next_seq % probe_slots;
+    if (probe.pending[slot])
+        probe.lost.fetch_add(1, std::memory_order_relaxed);
+    uint32_t seq = probe.next_seq & probe_seq_mask;
+    const jack_midi_data_t bytes[probe_size] =
+        { 0xf0, 0x7d, 'k', jack_midi_data_t(seq >> 7),
+            jack_midi_data_t(seq & 0x7f), 0xf7 };
+    void *buf = jack_port_get_buffer(probe.write_port, nframes);
+    if (jack_midi_event_write(buf, 0, bytes, probe_size) != 0)
+        return;
+    probe.sent_at[slot] = now;
+    probe.seqs[slot] = probe.next_seq;
+    probe.pending[slot] = true;
+    probe.next_seq++;
+    probe.next_send += probe.interval;
+    probe.sent.fetch_add(1, std::memory_order_relaxed);
 }
 
+
 // This runs in a high priority thread.
 static int
 process(jack_nframes_t nframes, void *arg)
@@ -114,56 +567,57 @@ process(jack_nframes_t nframes, void *arg)
     Client *client = static_cast<Client *>(arg);
     const jack_nframes_t now = jack_last_frame_time(client->client);
 
+    // These stay valid until I increment cycles at the end.
+    const port_list &read_ports = *client->read_ports.load();
+    const port_list &write_ports = *client->write_ports.load();
+    const route_list &routes = *client->routes.load();
+
     // Read incoming MIDI.  To guarantee all the ports are still valid, I
     // never unregister a port, only disconnect them.
-    for (int i = 0; i < MAX_PORTS; i++) {
-        jack_port_t *port = client->read_ports[i];
-        if (!port)
-            continue;
+    bool have_input = false;
+    bool probing = client->probe.running.load(std::memory_order_acquire);
+    for (jack_port_t *port : read_ports) {
         void *buf = jack_port_get_buffer(port, nframes);
 
         jack_nframes_t count = jack_midi_get_event_count(buf);
         for (jack_nframes_t j = 0; j < count; j++) {
-            midi_event event;
-            jack_midi_event_get(&event.event, buf, j);
-            event.port = port;
-            event.event.time += now;
-            if (!jack_ringbuffer_write(
-                client->input, (char *) &event, sizeof(event)))
+            jack_midi_event_t event;
+            jack_midi_event_get(&event, buf, j);
+            if (probing && port == client->probe.read_port
+                && is_probe(event.buffer, event.size))
             {
-                DEBUG("input buffer overrun");
-            } else {
-                sem_post(&client->available);
+                receive_probe(client->probe, event.time + now, event.buffer);
+                continue;
+            }
+            if (!routes.empty()) {
+                route_thru(client, routes, port, event.time + now,
+                    event.buffer, event.size);
             }
+            // The port buffer is only valid during this cycle, so the bytes
+            // go on the ringbuffer too.
+            have_input |= write_input(
+                client, port, event.time + now, event.buffer, event.size);
         }
     }
+    // Wake the reader once per cycle, not once per event.
+    if (have_input) {
+        uint64_t one = 1;
+        if (write(client->input_fd, &one, sizeof(one)) != sizeof(one))
+            DEBUG("eventfd write failed");
+    }
 
     // Write outgoing MIDI.  To guarantee all the ports are still valid, I
     // never unregister ports, only disconnect them.  The problem is that it's
     // hard to tell if any instances of the old port are still in the
-    // output ringbuffer.
-    midi_event event;
-    for (int i = 0; i < MAX_PORTS; i++) {
-        if (client->write_ports[i]) {
-            // DEBUG("clear buffer for " << client->write_ports[i]);
-            jack_midi_clear_buffer(
-                jack_port_get_buffer(client->write_ports[i], nframes));
-        }
-    }
-    while (jack_ringbuffer_read(client->immediate_output, (char *) &event,
-        sizeof(event)))
-    {
-        event.event.time = 0;
-        write_midi_event(nframes, event);
-    }
-    while (jack_ringbuffer_peek(client->output, (char *) &event, sizeof(event)))
-    {
-        event.event.time = now > event.event.time ? 0 : event.event.time - now;
-        if (event.event.time >= nframes)
-            break;
-        jack_ringbuffer_read_advance(client->output, sizeof(event));
-        write_midi_event(nframes, event);
+    // output queue.
+    for (jack_port_t *port : write_ports) {
+        // DEBUG("clear buffer for " << port);
+        jack_midi_clear_buffer(jack_port_get_buffer(port, nframes));
     }
+    if (probing)
+        send_probe(client, now, nframes);
+    write_output(client, write_ports, now, nframes);
+    client->cycles.fetch_add(1);
     return 0; // no error, but who knows what returning an error would do
 }
 
@@ -184,6 +638,10 @@ create_client(const char *client_name, NotifyCallback notify,
     *out_client = NULL;
     Client *client = new Client();
     client->notify = notify;
+    if (client->input_fd < 0) {
+        delete client;
+        return "eventfd() failed";
+    }
 
     // ensure client_name < jack_client_name_size()
     client->client = jack_client_open(client_name, JackNullOption, &status);
@@ -210,26 +668,41 @@ create_client(const char *client_name, NotifyCallback notify,
     // This is called called whenever a port is connected or disconnected
     failed = jack_set_port_registration_callback(
         client->client, port_registration_callback, client);
-    if (failed)
+    if (failed) {
+        destroy_client(client);
         return "jack_set_port_registration_callback() failed";
+    }
 
     failed = jack_set_port_connect_callback(
         client->client, port_connect_callback, client);
-    if (failed)
+    if (failed) {
+        destroy_client(client);
         return "jack_set_port_connect_callback() failed";
+    }
 
     failed = jack_set_process_callback(client->client, process, client);
-    if (failed)
+    if (failed) {
+        destroy_client(client);
         return "jack_set_process_callback failed";
+    }
 
     failed = jack_activate(client->client);
     if (failed) {
+        destroy_client(client);
         return "jack_activate() failed";
     }
     *out_client = client;
     return NULL;
 }
 
+void
+destroy_client(Client *client)
+{
+    // This waits for process() to finish, so the Client is no longer in use.
+    jack_client_close(client->client);
+    delete client;
+}
+
 
 // ports
 
@@ -347,63 +820,179 @@ get_port_aliases(Client *client, const char *name, char **alias1, char **alias2)
     return NULL;
 }
 
+jack_port_t *
+get_write_port(Client *client, const char *remote_name)
+{
+    std::string local_name = prepend_client(client, remote_name);
+    jack_port_t *port = jack_port_by_name(client->client, local_name.c_str());
+    if (port && !(jack_port_flags(port) & JackPortIsOutput))
+        return NULL;
+    return port;
+}
+
 // read / write
 
 const char *
-write_message(Client *client, const char *port, uint64_t time, void *bytes,
-    int size)
-{
-    midi_event event;
-    event.port = jack_port_by_name(client->client, port);
-    if (!event.port) {
-        // This just means a MIDI msg went to a nonexistent device.
-        // Return "" to tell the caller to report a failure but not otherwise
-        // freak out.
-        return "";
-    }
-    // DEBUG("write msg port " << port << ": " << event.port);
-    event.event.size = size;
-    event.event.time = jack_time_to_frames(client->client, time);
-    event.event.buffer = (jack_midi_data_t *) bytes;
-    jack_ringbuffer_t *ring =
-        time == 0 ? client->immediate_output : client-> output;
-    if (!jack_ringbuffer_write(ring, (char *) &event, sizeof(event))) {
+write_messages(Client *client, const write_record *records, int count,
+    const char *bytes)
+{
+    // Free large messages process() is done with.  If another writer is
+    // already doing it, it can wait until next time.
+    if (client->garbage_lock.try_lock()) {
+        client->collect_garbage();
+        client->garbage_lock.unlock();
+    }
+    // All the events are in the same generation, so an abort can't split
+    // them.
+    uint32_t generation = client->abort_generation.load();
+    jack_client_t *jack = client->client;
+    bool ok = client->output.pushMany(count,
+        [=](size_t i, output_event *event) {
+            const write_record &record = records[i];
+            event->port = record.port;
+            event->time = record.time == 0
+                ? 0 : jack_time_to_frames(jack, record.time);
+            event->size = record.size;
+            event->immediate = record.time == 0;
+            event->generation = generation;
+            event->seq = 0;
+            jack_midi_data_t *dest = event->bytes;
+            if (record.size > inline_bytes)
+                dest = event->large = new jack_midi_data_t[record.size];
+            memcpy(dest, bytes + record.offset, record.size);
+        });
+    if (!ok) {
+        client->overruns.fetch_add(count, std::memory_order_relaxed);
         return "output buffer overrun";
     }
     return NULL;
 }
 
+// Read the next record from the input ringbuffer into 'bytes'.  Return
+// false if there isn't a whole one.
+static bool
+read_input(Client *client, input_header *header, std::vector<char> &bytes)
+{
+    // process() writes the header and bytes separately, so make sure they're
+    // both there.
+    if (jack_ringbuffer_peek(client->input, (char *) header, sizeof(*header))
+            < sizeof(*header)
+        || jack_ringbuffer_read_space(client->input)
+            < sizeof(*header) + header->size)
+    {
+        return false;
+    }
+    jack_ringbuffer_read_advance(client->input, sizeof(*header));
+    bytes.resize(header->size);
+    jack_ringbuffer_read(client->input, bytes.data(), header->size);
+    return true;
+}
+
+// Add a record to the message being reassembled for its port.  If that
+// completes a message, return true, and put the message in 'bytes' and
+// its time in 'start'.
+static bool
+assemble(Client *client, const input_header &header,
+    std::vector<char> &bytes, jack_nframes_t *start)
+{
+    *start = header.time;
+    unsigned char status = bytes.empty() ? 0 : bytes[0];
+    auto partial = client->partial.find(header.port);
+    if (partial != client->partial.end()) {
+        if (status < 0x80 || status == 0xf7) {
+            std::vector<char> &sysex = partial->second.bytes;
+            sysex.insert(sysex.end(), bytes.begin(), bytes.end());
+            if (header.more)
+                return false;
+            // The sysex is complete, and gets the time of its start.
+            *start = partial->second.time;
+            bytes.swap(sysex);
+            client->partial.erase(partial);
+            return true;
+        } else if (status >= 0xf8) {
+            // Realtime messages can be interleaved with a sysex.
+            return true;
+        } else {
+            DEBUG("incomplete sysex from "
+                << jack_port_short_name(header.port));
+            client->partial.erase(partial);
+        }
+    }
+    if (!header.more)
+        return true;
+    partial_input &input = client->partial[header.port];
+    input.time = header.time;
+    input.bytes.swap(bytes);
+    return false;
+}
+
+const char *
+set_thru_routes(Client *client, const thru_record *records, int count)
+{
+    route_list *routes = new route_list();
+    for (int i = 0; i < count; i++) {
+        const thru_record &record = records[i];
+        thru_route route;
+        std::string from = prepend_client(client, record.from);
+        route.from = jack_port_by_name(client->client, from.c_str());
+        route.to = get_write_port(client, record.to);
+        if (!route.from || !(jack_port_flags(route.from) & JackPortIsInput)
+            || !route.to)
+        {
+            delete routes;
+            return "thru device not connected";
+        }
+        route.channels = record.channels;
+        route.channel = record.channel;
+        routes->push_back(route);
+    }
+    client->set_routes(routes);
+    return NULL;
+}
+
+int
+input_fd(Client *client)
+{
+    return client->input_fd;
+}
+
 int
-read_event(Client *client, const char **port, uint64_t *time, void **mevent)
+read_events(Client *client, read_record *records, int max,
+    const char **bytes)
 {
-    midi_event event;
-try_again:
-    // Incremented for every msg put on the ringbuffer.
-    sem_wait(&client->available);
+    // Clear the eventfd first, so anything that arrives after this sets it
+    // again.
+    uint64_t count;
+    if (read(client->input_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        DEBUG("eventfd read failed: " << strerror(errno));
 
-    size_t read = jack_ringbuffer_read(
-        client->input, (char *) &event, sizeof(event));
-    if (read < sizeof(event)) {
-        // This should never happen!
-        goto try_again;
+    std::vector<char> &out = client->read_buffer;
+    std::vector<char> &record = client->record_buffer;
+    out.clear();
+    int n = 0;
+    input_header header;
+    while (n < max && read_input(client, &header, record)) {
+        jack_nframes_t start;
+        if (!assemble(client, header, record, &start))
+            continue;
+        records[n].port = header.port;
+        records[n].time = jack_frames_to_time(client->client, start);
+        records[n].offset = out.size();
+        records[n].size = record.size();
+        out.insert(out.end(), record.begin(), record.end());
+        n++;
     }
-    *port = jack_port_short_name(event.port);
-    *time = jack_frames_to_time(client->client, event.event.time);
-    *mevent = event.event.buffer;
-    return event.event.size;
+    *bytes = out.data();
+    return n;
 }
 
 void
 jack_abort(Client *client)
 {
-    // jack_ringbuffer_reset is documented not thread safe, so I probably
-    // can't just call it while someone else may be reading it.  And
-    // jack_ringbuffer_read_advance doesn't say if it was able to advance or
-    // not.  So just suck all the events out one-by-one before process() can
-    // get them.
-    midi_event evt;
-    while (jack_ringbuffer_read(client->output, (char *) &evt, sizeof(evt)))
-        ;
+    // Only process() can read the output queue, so it does the discarding,
+    // and sends the all notes off.  Events written after this are in the new
+    // generation, so they survive.
+    client->abort_generation.fetch_add(1);
 }
 
 uint64_t
@@ -413,4 +1002,81 @@ now(Client *client)
         client->client, jack_frame_time(client->client));
 }
 
+static uint64_t
+get_stat(std::atomic<uint64_t> &stat, int reset)
+{
+    return reset ? stat.exchange(0) : stat.load();
+}
+
+void
+get_output_stats(Client *client, OutputStats *stats, int reset)
+{
+    stats->written = get_stat(client->written, reset);
+    stats->late = get_stat(client->late, reset);
+    stats->dropped = get_stat(client->dropped, reset);
+    stats->overruns = get_stat(client->overruns, reset);
+    // Convert frames to microseconds.
+    uint64_t srate = jack_get_sample_rate(client->client);
+    stats->late_max = get_stat(client->late_max, reset) * 1000000 / srate;
+    stats->late_total = get_stat(client->late_total, reset) * 1000000 / srate;
+}
+
+const char *
+start_latency_probe(Client *client, const char *write_remote,
+    const char *read_remote, int count, int interval_ms)
+{
+    latency_probe &probe = client->probe;
+    if (probe.running.load(std::memory_order_acquire))
+        return "latency probe already running";
+    if (count <= 0 || interval_ms <= 0)
+        return "count and interval must be positive";
+    probe.write_port = get_write_port(client, write_remote);
+    if (!probe.write_port)
+        return "write port not found";
+    std::string read_name = prepend_client(client, read_remote);
+    probe.read_port = jack_port_by_name(client->client, read_name.c_str());
+    if (!probe.read_port)
+        return "read port not found";
+
+    probe.srate = jack_get_sample_rate(client->client);
+    probe.count = count;
+    probe.interval = uint64_t(interval_ms) * probe.srate / 1000;
+    probe.started = false;
+    probe.next_seq = 0;
+    std::fill(probe.pending, probe.pending + probe_slots, false);
+    probe.have_last = false;
+    probe.sent.store(0);
+    probe.received.store(0);
+    probe.lost.store(0);
+    probe.min.store(~uint64_t(0));
+    probe.max.store(0);
+    probe.total.store(0);
+    for (auto &n : probe.latency)
+        n.store(0);
+    for (auto &n : probe.jitter)
+        n.store(0);
+    // process() won't look at any of the above until it sees this.
+    probe.running.store(true, std::memory_order_release);
+    return NULL;
+}
+
+void
+get_latency_stats(Client *client, LatencyStats *stats)
+{
+    const latency_probe &probe = client->probe;
+    stats->running = probe.running.load(std::memory_order_acquire);
+    stats->sent = probe.sent.load();
+    stats->received = probe.received.load();
+    stats->lost = probe.lost.load();
+    uint64_t srate = jack_get_sample_rate(client->client);
+    stats->min = stats->received == 0
+        ? 0 : probe.min.load() * 1000000 / srate;
+    stats->max = probe.max.load() * 1000000 / srate;
+    stats->total = probe.total.load() * 1000000 / srate;
+    for (int i = 0; i < latency_buckets; i++)
+        stats->latency[i] = probe.latency[i].load();
+    for (int i = 0; i < jitter_buckets; i++)
+        stats->jitter[i] = probe.jitter[i].load();
+}
+
 };
@@ -2,22 +2,206 @@
 // This program is distributed under the terms of the GNU General Public
 // License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
 
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <pthread.h>
-#include <semaphore.h>
+#include <vector>
 
 #include <jack/jack.h>
 #include <jack/midiport.h>
 #include <jack/ringbuffer.h>
 
+#include "MpscQueue.h"
 
-#define MAX_PORTS 64
 
 class Client;
 typedef void (*NotifyCallback)(
     Client *client, const char *port, int is_add, int is_read);
 
-// write_message looks up the port name, puts it on the ringbuffer with a ptr.
-// The msgs contain the port
+// The ports process() looks at.  This is never modified once process() can
+// see it, see Client::update_ports.
+typedef std::vector<jack_port_t *> port_list;
+
+enum {
+    // Messages up to this size are stored in the output_event itself, larger
+    // ones are allocated.
+    inline_bytes = 16
+};
+
+// An event on its way out.
+struct output_event {
+    jack_port_t *port;
+    // Absolute frame time, or 0 if immediate.
+    jack_nframes_t time;
+    uint32_t size;
+    // Written with time 0, so it should go out as soon as possible.
+    bool immediate;
+    // Client::abort_generation when it was written.  If there has been an
+    // abort since then, process() discards it.
+    uint32_t generation;
+    // Assigned by process() as events come off the queue, so events with the
+    // same time go out in the order they were written.
+    uint32_t seq;
+    union {
+        jack_midi_data_t bytes[inline_bytes];
+        // If size > inline_bytes, allocated by the writer.  process() sends
+        // it back on Client::garbage when it's done with it.
+        jack_midi_data_t *large;
+    };
+
+    const jack_midi_data_t *data() const {
+        return size > inline_bytes ? large : bytes;
+    }
+};
+
+// A sysex which is going out in fragments, see write_output.
+struct sysex_stream {
+    output_event event;
+    // Bytes already written.
+    uint32_t sent;
+};
+
+// The input ringbuffer has one of these for each event, followed by 'size'
+// bytes of the message.
+struct input_header {
+    jack_port_t *port;
+    // Absolute frame time.
+    jack_nframes_t time;
+    uint32_t size;
+    // The message continues in a later record for the same port.  This is
+    // either because process() split it, or because JACK delivered an
+    // unterminated sysex.
+    bool more;
+};
+
+// A message returned by read_events.
+struct read_record {
+    jack_port_t *port;
+    // Microseconds.
+    uint64_t time;
+    // The message is at [offset, offset+size) of the bytes buffer.
+    uint32_t offset;
+    uint32_t size;
+};
+
+// A sysex being reassembled by read_events.
+struct partial_input {
+    jack_nframes_t time;
+    std::vector<char> bytes;
+};
+
+// A message for write_messages.
+struct write_record {
+    // From get_write_port.
+    jack_port_t *port;
+    // Microseconds, or 0 to write immediately.
+    uint64_t time;
+    // The message is at [offset, offset+size) of the bytes buffer.
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Send channel messages from a read port straight to a write port in
+// process(), see set_thru_routes.
+struct thru_route {
+    jack_port_t *from;
+    jack_port_t *to;
+    // Bit n is set if channel n goes thru.
+    uint16_t channels;
+    // Rechannel to this channel, or -1 to leave it alone.
+    int8_t channel;
+};
+
+// Like port_list, this is replaced, not modified.
+typedef std::vector<thru_route> route_list;
+
+// A route for set_thru_routes.  The devices are remote port names, as for
+// create_read_port and create_write_port.
+struct thru_record {
+    const char *from;
+    const char *to;
+    uint32_t channels;
+    int32_t channel;
+};
+
+// Statistics for the output scheduler, see get_output_stats.
+struct OutputStats {
+    // Events written to a JACK port buffer.
+    uint64_t written;
+    // Events that were already in the past when they were scheduled, so they
+    // went out at the start of the cycle.
+    uint64_t late;
+    // How late, in microseconds.
+    uint64_t late_max;
+    uint64_t late_total;
+    // Events that didn't fit in the JACK port buffer.
+    uint64_t dropped;
+    // Messages that write_messages dropped because the output queue was full.
+    uint64_t overruns;
+};
+
+enum {
+    // Round trip histogram buckets, and microseconds per bucket.
+    latency_buckets = 128,
+    latency_bucket_us = 250,
+    jitter_buckets = 64,
+    jitter_bucket_us = 50,
+    // Probes which may be outstanding at once.
+    probe_slots = 128
+};
+
+// Results of a latency probe, see start_latency_probe.  Times are in
+// microseconds.  The last bucket of each histogram also counts everything
+// past it.
+struct LatencyStats {
+    uint32_t sent;
+    uint32_t received;
+    // Never came back, or came back too late.
+    uint32_t lost;
+    int running;
+    uint64_t min;
+    uint64_t max;
+    uint64_t total;
+    // Round trip times.
+    uint32_t latency[latency_buckets];
+    // Difference between successive round trips.
+    uint32_t jitter[jitter_buckets];
+};
+
+// Probe state.  start_latency_probe sets the configuration before it sets
+// 'running', and after that only process() touches it, except for the
+// results, which anyone can read.
+struct latency_probe {
+    jack_port_t *write_port;
+    jack_port_t *read_port;
+    uint32_t count;
+    jack_nframes_t interval;
+    jack_nframes_t srate;
+    std::atomic<bool> running;
+
+    // Only touched by process().
+    bool started;
+    uint32_t next_seq;
+    jack_nframes_t next_send;
+    // Indexed by seq % probe_slots.
+    jack_nframes_t sent_at[probe_slots];
+    uint32_t seqs[probe_slots];
+    bool pending[probe_slots];
+    jack_nframes_t last_trip;
+    bool have_last;
+
+    // Results, in frames.
+    std::atomic<uint32_t> sent, received, lost;
+    std::atomic<uint64_t> min, max, total;
+    std::atomic<uint32_t> latency[latency_buckets];
+    std::atomic<uint32_t> jitter[jitter_buckets];
+};
+
+// write_messages copies the messages onto the output queue.  process() moves
+// events from the queue into a heap sorted by time, and writes the ones which
+// fall into the current cycle.  So events don't have to be written in order,
+// as long as they're not written too far in advance.
 struct Client {
     Client();
     ~Client();
@@ -27,35 +211,100 @@ struct Client {
     void add_read_port(jack_port_t *port);
     void remove_read_port(jack_port_t *port);
     void add_write_port(jack_port_t *port);
+    void set_routes(const route_list *routes);
+    // Send a large message back to be freed.  Only process() calls this.
+    void release(const output_event &event);
+    // Free released messages.  Only one thread at a time may call this.
+    void collect_garbage();
 
-    jack_port_t *read_ports[MAX_PORTS];
+    // These are replaced, not modified, so process() can read them without
+    // locking, and only has to look at live ports.
+    std::atomic<const port_list *> read_ports;
     // The only reason I need these is to clear them on each process cycle.
     // Too bad JACK doesn't have a way to ask for my ports in process().
-    jack_port_t *write_ports[MAX_PORTS];
-    sem_t available; // How many events are on the input buffer.
+    std::atomic<const port_list *> write_ports;
+    std::atomic<const route_list *> routes;
+    // Incremented at the end of every process().  Once it has changed,
+    // process() is no longer using any port_list replaced before that.
+    std::atomic<uint64_t> cycles;
+    // An eventfd.  process() signals it when it has put events on the input
+    // buffer, and read_events clears it.
+    int input_fd;
 
-    jack_ringbuffer_t *immediate_output;
-    jack_ringbuffer_t *output;
+    // Any thread may write, only process() reads.
+    MpscQueue<output_event> output;
+    // process() puts output_event::large here when it's done with it, and
+    // writers free them.  It's big enough to hold every large event that
+    // can be in the output queue and the schedule, so it can't fill up.
+    MpscQueue<jack_midi_data_t *> garbage;
+    std::mutex garbage_lock; // Writers take this to empty garbage.
+    // process() writes input_headers and message bytes, read_events reads.
     jack_ringbuffer_t *input;
-};
+    // read_events copies messages here, so they stay valid until the next
+    // read_events.  Only the reader thread touches these, so they can grow.
+    std::vector<char> read_buffer;
+    std::vector<char> record_buffer;
+    std::map<jack_port_t *, partial_input> partial;
 
-enum {
-    output_buffer_size = 4 * 1024,
-    // VL1 sysex dumps can get up to 400K, but I guess I can deal with that
-    // if it becomes a problem.
-    immediate_output_buffer_size = 8 * 1024,
-    input_buffer_size = 8 * 1024
+    // Only touched by process().  This is a binary heap with the earliest
+    // event at the front.  Its capacity is reserved up front, so it never
+    // allocates.
+    std::vector<output_event> schedule;
+    uint32_t next_seq;
+    // Incremented by jack_abort.  process() discards events from older
+    // generations.
+    std::atomic<uint32_t> abort_generation;
+    // The generation of the events in the schedule.
+    uint32_t generation;
+    // Set when process() sees an abort, so it silences the write ports.
+    bool aborted;
+    // Sysexes too big to write in one cycle.  While a port has one, its
+    // other events wait in 'deferred'.  Both have reserved capacity.
+    std::vector<sysex_stream> streams;
+    std::vector<output_event> deferred;
+    // Routed input from this cycle, waiting for write_output to put it on
+    // the schedule.  Also reserved.
+    std::vector<output_event> thru;
+
+    // Updated by process(), except overruns, which is updated by writers.
+    // Lateness is in frames.
+    std::atomic<uint64_t> written, late, late_max, late_total, dropped,
+        overruns;
+    latency_probe probe;
+private:
+    void update_ports(std::atomic<const port_list *> &list,
+        jack_port_t *port, bool add);
+    void reclaim_ports();
+
+    std::mutex ports_lock; // Taken by update_ports and set_routes.
+    // Replaced port_lists, and the value of 'cycles' when they were replaced.
+    std::vector<std::pair<const port_list *, uint64_t>> retired;
+    std::vector<std::pair<const route_list *, uint64_t>> retired_routes;
 };
 
-struct midi_event {
-    jack_port_t *port;
-    jack_midi_event_t event;
+enum {
+    // Events, not bytes.  The queue size must be a power of 2.
+    output_queue_size = 4 * 1024,
+    schedule_size = 8 * 1024,
+    garbage_size = 16 * 1024,
+    max_streams = 16,
+    // Thru events per cycle.
+    thru_size = 1024,
+    // Sysexes longer than this go out in fragments, at most one per cycle
+    // per port.  This also keeps one dump from filling the port buffer.
+    sysex_fragment_bytes = 1024,
+    // process() splits incoming messages into records of at most this size,
+    // so a big one can use the ringbuffer as read_events empties it.
+    input_chunk_bytes = 1024,
+    input_buffer_size = 64 * 1024
 };
 
 extern "C" {
 
 const char *create_client(const char *client_name, NotifyCallback notify,
     Client **out_client);
+// Close the JACK client and free the Client.  Nothing else may be using it.
+void destroy_client(Client *client);
 
 // ports
 const char *create_read_port(Client *client, const char *remote_name);
@@ -63,13 +312,46 @@ const char *remove_read_port(Client *client, const char *remote_name);
 const char *create_write_port(Client *client, const char *remote_name);
 const char **get_midi_ports(Client *client, unsigned long flags);
 
+// Look up the local port connected to the remote one, which was created by
+// create_write_port.  It's never unregistered, so it can be kept.
+jack_port_t *get_write_port(Client *client, const char *remote_name);
+
 // read and write
-const char *write_message(Client *client, const char *port, uint64_t time,
-    void *bytes, int size);
+// Write a batch of messages.  Either they all go on the output queue, or
+// none do.  The bytes are copied, so the caller can free them right away.
+const char *write_messages(Client *client, const write_record *records,
+    int count, const char *bytes);
+
+// Replace the thru routes.  Incoming channel messages that match a route are
+// written to its write port in the same cycle, and also go to read_events as
+// usual.  Sysex and system messages aren't routed.
+const char *set_thru_routes(Client *client, const thru_record *records,
+    int count);
 
-// Block until an event arrives, then fill it in.
-int read_event(Client *client, const char **port, uint64_t *time,
-    void **mevent);
+// The fd to wait on before calling read_events.  It becomes readable when
+// there are events.
+int input_fd(Client *client);
+// Read up to 'max' events into 'records' without blocking, and return how
+// many there were.  The message bytes are in '*bytes', which is valid until
+// the next call.  If this returns 'max', there may be more, so call it again
+// before waiting on input_fd.
+int read_events(Client *client, read_record *records, int max,
+    const char **bytes);
+// Discard everything written so far, and on the next cycle send all notes
+// off and reset all controllers on every channel of every write port.  This
+// doesn't block, and events written after it are kept.
 void jack_abort(Client *client);
 uint64_t now(Client *client);
+
+// Get the output statistics accumulated since the last reset.
+void get_output_stats(Client *client, OutputStats *stats, int reset);
+
+// Send 'count' probe sysexes to write_remote, one every 'interval_ms', and
+// time how long they take to come back on read_remote.  The two must be
+// connected by a loopback, either a cable or another client.  Probes are
+// consumed by process(), so they don't show up in read_events.
+const char *start_latency_probe(Client *client, const char *write_remote,
+    const char *read_remote, int count, int interval_ms);
+// Get the results so far.  LatencyStats::running is 0 when the probe is done.
+void get_latency_stats(Client *client, LatencyStats *stats);
 }
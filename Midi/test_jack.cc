@@ -0,0 +1,425 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// Test and benchmark the JACK binding against Midi/fake_jack.
+//
+// The fake server only runs a process cycle when told to, so this is
+// deterministic, and doesn't need a JACK server.  The tests check ordering,
+// overruns, abort, thru, sysex delivery, and the latency probe.  The benchmark pushes events
+// through write_messages, process(), and read_events, and reports throughput
+// as JSON on stdout.
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Midi/jack.h"
+#include "fake_jack.h"
+#include "fltk/bench.h"
+
+
+enum { buffer_size = 256, sample_rate = 44100 };
+
+static int failures = 0;
+
+#define CHECK(x) do { if (!(x)) { \
+    std::cerr << __FILE__ << ':' << __LINE__ << ": failed: " << #x << '\n'; \
+    failures++; \
+} } while (0)
+
+
+// The fake server never adds or removes ports on its own.
+static void
+notify(Client *, const char *, int, int)
+{
+}
+
+
+static Client *
+open_client()
+{
+    Client *client;
+    const char *err = create_client("karya", notify, &client);
+    if (err) {
+        std::cerr << "create_client: " << err << '\n';
+        exit(1);
+    }
+    return client;
+}
+
+
+static uint64_t
+frames_to_us(jack_nframes_t frames)
+{
+    return uint64_t(frames) * 1000000 / sample_rate;
+}
+
+
+// Events written out of order come out in time order, and events with the
+// same time come out in the order they were written.
+static void
+test_order()
+{
+    fake_jack_reset(buffer_size, sample_rate);
+    fake_jack_add_device("synth:in", JackPortIsInput);
+    Client *client = open_client();
+    create_write_port(client, "synth:in");
+    jack_port_t *port = get_write_port(client, "synth:in");
+
+    enum { count = 1000 };
+    std::vector<jack_nframes_t> times;
+    for (int i = 0; i < count; i++)
+        times.push_back(buffer_size + (i / 2) * 37);
+    std::shuffle(times.begin(), times.end(), std::mt19937(42));
+    std::vector<write_record> records;
+    std::vector<char> bytes;
+    for (jack_nframes_t time : times) {
+        // The key and velocity are the write order.
+        int index = records.size();
+        write_record record =
+            { port, frames_to_us(time), uint32_t(bytes.size()), 3 };
+        records.push_back(record);
+        bytes.push_back(char(0x90));
+        bytes.push_back(char(index / 128));
+        bytes.push_back(char(index % 128));
+    }
+    CHECK(write_messages(client, records.data(), records.size(), bytes.data())
+        == nullptr);
+
+    std::vector<FakeEvent> received;
+    for (int i = 0; i < 200; i++) {
+        fake_jack_cycle();
+        std::vector<FakeEvent> events = fake_jack_received("synth:in");
+        received.insert(received.end(), events.begin(), events.end());
+    }
+    CHECK(received.size() == count);
+    auto index = [](const FakeEvent &event) {
+        return event.bytes[1] * 128 + event.bytes[2];
+    };
+    for (size_t i = 1; i < received.size(); i++) {
+        CHECK(received[i-1].time <= received[i].time);
+        if (received[i-1].time == received[i].time)
+            CHECK(index(received[i-1]) < index(received[i]));
+    }
+    FakeErrors errors = fake_jack_errors();
+    CHECK(errors.misordered == 0);
+    CHECK(errors.overflowed == 0);
+    destroy_client(client);
+}
+
+
+// A batch that doesn't fit on the output queue fails as a whole, and is
+// counted as overruns.
+static void
+test_overrun()
+{
+    fake_jack_reset(buffer_size, sample_rate);
+    fake_jack_add_device("synth:in", JackPortIsInput);
+    Client *client = open_client();
+    create_write_port(client, "synth:in");
+    jack_port_t *port = get_write_port(client, "synth:in");
+
+    const char note[] = { char(0x90), 60, 100 };
+    std::vector<write_record> records(output_queue_size - 1,
+        write_record { port, 0, 0, 3 });
+    CHECK(write_messages(client, records.data(), records.size(), note)
+        == nullptr);
+    records.resize(2);
+    CHECK(write_messages(client, records.data(), records.size(), note)
+        != nullptr);
+    OutputStats stats;
+    get_output_stats(client, &stats, 0);
+    CHECK(stats.overruns == 2);
+    fake_jack_cycle();
+    CHECK(write_messages(client, records.data(), records.size(), note)
+        == nullptr);
+    destroy_client(client);
+}
+
+
+// Abort discards everything queued, silences every channel, and keeps what
+// was written after it.
+static void
+test_abort()
+{
+    fake_jack_reset(buffer_size, sample_rate);
+    fake_jack_add_device("synth:in", JackPortIsInput);
+    Client *client = open_client();
+    create_write_port(client, "synth:in");
+    jack_port_t *port = get_write_port(client, "synth:in");
+
+    const char note[] = { char(0x90), 60, 100 };
+    std::vector<write_record> records;
+    for (int i = 0; i < 1000; i++) {
+        records.push_back(write_record
+            { port, frames_to_us(buffer_size * 4 + i), 0, 3 });
+    }
+    CHECK(write_messages(client, records.data(), records.size(), note)
+        == nullptr);
+    fake_jack_cycle();
+    jack_abort(client);
+    write_record after = { port, 0, 0, 3 };
+    CHECK(write_messages(client, &after, 1, note) == nullptr);
+    std::vector<FakeEvent> received;
+    for (int i = 0; i < 20; i++) {
+        fake_jack_cycle();
+        std::vector<FakeEvent> events = fake_jack_received("synth:in");
+        received.insert(received.end(), events.begin(), events.end());
+    }
+    CHECK(received.size() == 16 * 2 + 1);
+    for (size_t i = 0; i + 1 < received.size(); i++) {
+        CHECK((received[i].bytes[0] & 0xf0) == 0xb0);
+        CHECK(received[i].bytes[1] == (i % 2 == 0 ? 123 : 121));
+    }
+    if (!received.empty())
+        CHECK(received.back().bytes[0] == 0x90);
+    destroy_client(client);
+}
+
+
+// Routed input goes out in the same cycle it came in, and also goes to
+// read_events.
+static void
+test_thru()
+{
+    fake_jack_reset(buffer_size, sample_rate);
+    fake_jack_add_device("kbd:out", JackPortIsOutput);
+    fake_jack_add_device("synth:in", JackPortIsInput);
+    Client *client = open_client();
+    create_read_port(client, "kbd:out");
+    create_write_port(client, "synth:in");
+    thru_record route = { "kbd:out", "synth:in", 1 << 0, 3 };
+    CHECK(set_thru_routes(client, &route, 1) == nullptr);
+    thru_record bad = { "kbd:out", "nowhere:in", 0xffff, -1 };
+    CHECK(set_thru_routes(client, &bad, 1) != nullptr);
+
+    const jack_midi_data_t note0[] = { 0x90, 60, 100 };
+    const jack_midi_data_t note5[] = { 0x95, 62, 100 };
+    const jack_midi_data_t sysex[] = { 0xf0, 0x7d, 1, 0xf7 };
+    fake_jack_send("kbd:out", 10, note0, 3);
+    fake_jack_send("kbd:out", 20, note5, 3);
+    fake_jack_send("kbd:out", 30, sysex, 4);
+    fake_jack_cycle();
+    std::vector<FakeEvent> received = fake_jack_received("synth:in");
+    CHECK(received.size() == 1);
+    if (received.size() == 1) {
+        CHECK(received[0].time == 10);
+        CHECK(received[0].bytes[0] == 0x93);
+    }
+    read_record records[4];
+    const char *bytes;
+    CHECK(read_events(client, records, 4, &bytes) == 3);
+
+    set_thru_routes(client, nullptr, 0);
+    fake_jack_send("kbd:out", 10, note0, 3);
+    fake_jack_cycle();
+    CHECK(fake_jack_received("synth:in").empty());
+    destroy_client(client);
+}
+
+
+// A sysex too big for one cycle goes out in fragments and comes back intact.
+static void
+test_sysex()
+{
+    fake_jack_reset(buffer_size, sample_rate);
+    fake_jack_add_device("synth:in", JackPortIsInput);
+    fake_jack_add_device("synth:out", JackPortIsOutput);
+    fake_jack_loopback("synth:in", "synth:out");
+    Client *client = open_client();
+    create_write_port(client, "synth:in");
+    create_read_port(client, "synth:out");
+    jack_port_t *port = get_write_port(client, "synth:in");
+
+    std::vector<char> sysex(64 * 1024);
+    for (size_t i = 0; i < sysex.size(); i++)
+        sysex[i] = i % 128;
+    sysex.front() = char(0xf0);
+    sysex.back() = char(0xf7);
+    write_record record = { port, 0, 0, uint32_t(sysex.size()) };
+    CHECK(write_messages(client, &record, 1, sysex.data()) == nullptr);
+
+    read_record records[16];
+    const char *bytes;
+    int n = 0;
+    for (int i = 0; i < 200 && n == 0; i++) {
+        fake_jack_cycle();
+        n = read_events(client, records, 16, &bytes);
+    }
+    CHECK(n == 1);
+    if (n == 1) {
+        CHECK(records[0].size == sysex.size());
+        CHECK(memcmp(bytes + records[0].offset, sysex.data(), sysex.size())
+            == 0);
+    }
+    destroy_client(client);
+}
+
+
+// Probes sent around a loopback all come back, are timed, and don't show up
+// in read_events, while ordinary input still does.
+static void
+test_latency_probe()
+{
+    fake_jack_reset(buffer_size, sample_rate);
+    fake_jack_add_device("synth:in", JackPortIsInput);
+    fake_jack_add_device("synth:out", JackPortIsOutput);
+    fake_jack_loopback("synth:in", "synth:out");
+    Client *client = open_client();
+    create_write_port(client, "synth:in");
+    create_read_port(client, "synth:out");
+    jack_port_t *port = get_write_port(client, "synth:in");
+
+    enum { count = 50 };
+    CHECK(start_latency_probe(client, "synth:in", "nowhere:out", count, 10)
+        != nullptr);
+    CHECK(start_latency_probe(client, "synth:in", "synth:out", count, 10)
+        == nullptr);
+    const char note[] = { char(0x90), 60, 100 };
+    write_record record = { port, 0, 0, 3 };
+    CHECK(write_messages(client, &record, 1, note) == nullptr);
+
+    LatencyStats stats;
+    int notes = 0, probes = 0;
+    for (int i = 0; i < 1000; i++) {
+        fake_jack_cycle();
+        read_record records[16];
+        const char *bytes;
+        int n = read_events(client, records, 16, &bytes);
+        for (int j = 0; j < n; j++) {
+            const char *event = bytes + records[j].offset;
+            if (uint8_t(event[0]) == 0xf0)
+                probes++;
+            else
+                notes++;
+        }
+        get_latency_stats(client, &stats);
+        if (!stats.running)
+            break;
+    }
+    CHECK(!stats.running);
+    CHECK(notes == 1);
+    CHECK(probes == 0);
+    CHECK(stats.sent == count);
+    CHECK(stats.received == count);
+    CHECK(stats.lost == 0);
+    CHECK(stats.min <= stats.max);
+    CHECK(stats.total >= stats.min * count);
+    uint32_t trips = 0, jitters = 0;
+    for (int i = 0; i < latency_buckets; i++)
+        trips += stats.latency[i];
+    for (int i = 0; i < jitter_buckets; i++)
+        jitters += stats.jitter[i];
+    CHECK(trips == count);
+    CHECK(jitters == count - 1);
+    destroy_client(client);
+}
+
+
+// Push events around a loopback, a cycle's worth at a time.
+static void
+bench(std::ostream &out, int total, int per_cycle)
+{
+    fake_jack_reset(buffer_size, sample_rate);
+    fake_jack_add_device("synth:in", JackPortIsInput);
+    fake_jack_add_device("synth:out", JackPortIsOutput);
+    fake_jack_loopback("synth:in", "synth:out");
+    Client *client = open_client();
+    create_write_port(client, "synth:in");
+    create_read_port(client, "synth:out");
+    jack_port_t *port = get_write_port(client, "synth:in");
+
+    std::vector<write_record> records(per_cycle);
+    std::vector<char> bytes(per_cycle * 3);
+    std::vector<read_record> read(per_cycle * 2);
+    const char *read_bytes;
+    int sent = 0, received = 0, misordered = 0;
+    jack_nframes_t frame = 0, last_time = 0;
+    double write_ns = 0, cycle_ns = 0, read_ns = 0;
+    while (received < total) {
+        int n = std::min(per_cycle, total - sent);
+        for (int i = 0; i < n; i++) {
+            // Spread them over the next cycle.
+            jack_nframes_t time =
+                frame + buffer_size + i * buffer_size / per_cycle;
+            records[i] = write_record
+                { port, frames_to_us(time), uint32_t(i * 3), 3 };
+            bytes[i*3] = char(0x90);
+            bytes[i*3 + 1] = char((sent + i) % 128);
+            bytes[i*3 + 2] = 64;
+        }
+        BenchTimer timer;
+        if (n > 0 && write_messages(client, records.data(), n, bytes.data())
+                == nullptr)
+            sent += n;
+        write_ns += timer.lap_ns();
+        fake_jack_cycle();
+        frame += buffer_size;
+        cycle_ns += timer.lap_ns();
+        int got = read_events(client, read.data(), read.size(), &read_bytes);
+        read_ns += timer.lap_ns();
+        for (int i = 0; i < got; i++) {
+            if (int32_t(read[i].time - last_time) < 0)
+                misordered++;
+            last_time = read[i].time;
+        }
+        received += got;
+        if (n == 0 && got == 0)
+            break;
+    }
+
+    OutputStats stats;
+    get_output_stats(client, &stats, 0);
+    FakeErrors errors = fake_jack_errors();
+    double total_ns = write_ns + cycle_ns + read_ns;
+    out << "{\"events\": " << total
+        << ", \"per_cycle\": " << per_cycle
+        << ", \"received\": " << received
+        << ", \"events_per_sec\": "
+            << (total_ns > 0 ? received * 1e9 / total_ns : 0)
+        << ", \"write_ns\": " << write_ns / total
+        << ", \"process_ns\": " << cycle_ns / total
+        << ", \"read_ns\": " << read_ns / total
+        << ", \"late\": " << stats.late
+        << ", \"dropped\": " << stats.dropped
+        << ", \"overruns\": " << stats.overruns
+        << ", \"misordered\": " << misordered + errors.misordered
+        << "}";
+    CHECK(received == total);
+    CHECK(misordered == 0 && errors.misordered == 0);
+    destroy_client(client);
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int events = 1000000;
+    if (!bench_args(argc, argv, { {"--events", &events} }))
+        return 1;
+    test_order();
+    test_overrun();
+    test_abort();
+    test_thru();
+    test_sysex();
+    test_latency_probe();
+    std::cout << "{\"sample_rate\": " << sample_rate
+        << ", \"buffer_size\": " << buffer_size
+        << ",\n\"bench\": [\n";
+    const int per_cycle[] = { 1, 16, 256 };
+    for (int i = 0; i < 3; i++) {
+        if (i > 0)
+            std::cout << ",\n";
+        std::cout << "    ";
+        // One event per cycle is slow, so don't do as many.
+        bench(std::cout, per_cycle[i] == 1 ? events / 100 : events,
+            per_cycle[i]);
+    }
+    std::cout << "\n]}\n";
+    if (failures)
+        std::cerr << failures << " failures\n";
+    return failures ? 1 : 0;
+}
@@ -108,11 +108,11 @@ make_state info = do
 write_ahead :: RealTime
 write_ahead = RealTime.seconds 1
 
-state_write :: State -> Interface.Message -> IO ()
+state_write :: State -> [Interface.Message] -> IO ()
 state_write state = Transport.info_midi_writer (state_info state)
 
 state_write_midi :: State -> Midi.WriteMessage -> IO ()
-state_write_midi state = state_write state . Interface.Midi
+state_write_midi state = state_write state . (:[]) . Interface.Midi
 
 -- | @devs@ keeps track of devices that have been seen, so I know which devices
 -- to reset.
@@ -125,7 +125,10 @@ play_loop state msgs = do
     let (chunk, rest) =
             span (LEvent.either ((<until) . Midi.wmsg_ts) (const True)) msgs
     -- Log.debug $ "play at " ++ show now ++ " chunk: " ++ show (length chunk)
-    mapM_ (LEvent.either (state_write_midi state) Log.write) chunk
+    -- Write the whole chunk in one batch, so the driver gets it in one call.
+    let (wmsgs, logs) = LEvent.partition chunk
+    mapM_ Log.write logs
+    state_write state (map Interface.Midi wmsgs)
 
     -- Don't quit until all events have been played.
     let timeout = if null rest
@@ -134,7 +137,7 @@ play_loop state msgs = do
             else write_ahead
     stop <- Transport.poll_stop_player (RealTime.to_diff timeout)
         (state_play_control state)
-    let reset_midi = state_write state (Interface.AllNotesOff now)
+    let reset_midi = state_write state [Interface.AllNotesOff now]
     case (stop, rest) of
         (True, _) -> do
             Transport.info_midi_abort (state_info state)
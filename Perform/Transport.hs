@@ -44,7 +44,8 @@ instance Pretty Status where
 data Info = Info {
     -- | Send status messages back to the responder loop.
     info_send_status :: Status -> IO ()
-    , info_midi_writer :: Interface.Message -> IO ()
+    -- | Write a batch of messages, see 'Interface.write_messages'.
+    , info_midi_writer :: [Interface.Message] -> IO ()
     -- | Action that will abort any pending midi msgs written with the midi
     -- writer.
     , info_midi_abort :: IO ()
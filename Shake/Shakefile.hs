@@ -405,8 +405,7 @@ hsToCc = Map.fromList $
     , ("LogView/LogViewC.hsc", ["LogView/interface.cc"])
     , ("Instrument/BrowserC.hsc", ["Instrument/interface.cc"])
     , ("Util/Fltk.hs", ["Util/fltk_interface.cc"])
-    , ("Synth/Faust/DriverC.hs",
-        map ("Synth/Faust"</>) ["driver.cc", "Patch.cc"])
+    , ("Synth/Faust/DriverC.hs", faustCc)
     ] ++
     [ (hsc, ["Ui/c_interface.cc"])
     | hsc <- ["Ui/BlockC.hsc", "Ui/RulerC.hsc", "Ui/StyleC.hsc",
@@ -416,6 +415,10 @@ hsToCc = Map.fromList $
 criterionHsSuffix :: FilePath
 criterionHsSuffix = "_criterion.hs"
 
+-- | C++ sources for the faust driver, shared by DriverC and bench_faust.
+faustCc :: [FilePath]
+faustCc = map ("Synth/Faust"</>) ["driver.cc", "Patch.cc", "Voices.cc"]
+
 -- ** cc
 
 {- | Describe a C++ binary target.  Unlike 'HsBinary', this has all the
@@ -443,6 +446,7 @@ ccDeps config binary = map (oDir config </>) (ccRelativeDeps binary)
 ccBinaries :: [CcBinary]
 ccBinaries =
     [ fltk "test_block" ["fltk/test_block.cc.o", "fltk/fltk.a"]
+    , fltk "bench_symbols" ["fltk/bench_symbols.cc.o", "fltk/fltk.a"]
     , fltk "test_browser"
         [ "Instrument/test_browser.cc.o", "Instrument/browser_ui.cc.o"
         , "fltk/f_util.cc.o"
@@ -451,7 +455,17 @@ ccBinaries =
         [ "LogView/test_logview.cc.o", "LogView/logview_ui.cc.o"
         , "fltk/f_util.cc.o"
         ]
-    ] ++ if not (Config.enableIm localConfig) then [] else
+    ] ++ (if Util.platform /= Util.Linux then [] else
+    -- Test Midi/jack.cc against an in-process fake JACK server.
+    [ (plain "test_jack"
+            [ "Midi/test_jack.cc.o", "Midi/fake_jack/fake_client.cc.o"
+            , "Midi/fake_jack/fake_jack.cc.o"
+            ])
+        -- The fake headers shadow the real <jack/jack.h>.
+        { ccCompileFlags = const ["-IMidi/fake_jack"]
+        , ccLinkFlags = const ["-lpthread"]
+        }
+    ]) ++ if not (Config.enableIm localConfig) then [] else
     [ playCacheBinary
     , (plain "test_play_cache" $
             "Synth/play_cache/test_play_cache.cc.o" : playCacheDeps)
@@ -459,6 +473,10 @@ ccBinaries =
             Util.Linux -> ["-lpthread"]
             Util.Mac -> []
         }
+    , (plain "bench_faust" $ "Synth/Faust/bench_faust.cc.o" : faustDeps)
+        -- faustDeps are also linked into DriverC, which gets the default
+        -- 'fltkCc' flags from 'ccORule', so keep them the same.
+        { ccCompileFlags = fltkCc . configFlags }
     ]
     where
     fltk name deps = CcBinary
@@ -508,6 +526,9 @@ playCacheBinary = CcBinary
         -- aeffect.h is broken for linux, suppressing __cdecl fixes it.
         Util.Linux -> ["-fPIC", "-D__cdecl="]
 
+faustDeps :: [FilePath]
+faustDeps = map (++".o") faustCc
+
 playCacheDeps :: [FilePath]
 playCacheDeps = map (("Synth/play_cache"</>) . (++".o"))
     [ "Mix.cc", "SampleDirectory.cc", "Streamer.cc"
@@ -528,6 +549,7 @@ fltkDeps config = map (srcToObj config . ("fltk"</>))
     [ "AbbreviatedInput.cc"
     , "Block.cc"
     , "Color.cc"
+    , "EventStore.cc"
     , "EventTrack.cc"
     , "FloatingInput.cc"
     , "MoveTile.cc"
@@ -537,6 +559,7 @@ fltkDeps config = map (srcToObj config . ("fltk"</>))
     , "Scrollbar.cc"
     , "Selection.cc"
     , "SelectionOverlay.cc"
+    , "SignalSamples.cc"
     , "SimpleScroll.cc"
     , "SkeletonDisplay.cc"
     , "StyleTable.cc"
@@ -8,13 +8,19 @@ module Synth.Faust.DriverC (
     , getPatches
     , ControlConfig(..), getParsedMetadata
     , getControls
-    , getUiControls
+    , getUiControls, setUiControls
     -- * Instrument
     , withInstrument, initialize, destroy
-    , patchInputs, patchOutputs
+    , patchInputs, patchOutputs, patchLatency
     , render
+    , Silence(..), renderDetect
     -- ** state
     , getState, unsafeGetState, putState
+    -- * Voices
+    , Voices, NoteId
+    , withVoices, initializeVoices, destroyVoices
+    , renderVoices, renderVoicesDetect
+    , getVoicesState, putVoicesState
 ) where
 import qualified Control.Exception as Exception
 import qualified Data.ByteString as ByteString
@@ -156,27 +162,41 @@ foreign import ccall "faust_metadata"
     c_faust_metadata :: Patch -> Ptr (Ptr CString) -> Ptr (Ptr CString)
         -> IO CInt
 
-getUiControls :: Patch -> IO [(Control.Control, Ptr CFloat, Text)]
+-- | Get UI controls and their docs.  A control is identified by its index in
+-- this list, for 'setUiControls'.
+getUiControls :: Patch -> IO [(Control.Control, Text)]
 getUiControls patch = do
-    (count, controlsp, docsp, valsp) <-
-        alloca $ \controlspp -> alloca $ \docspp -> alloca $ \valspp -> do
-            count <- c_faust_controls patch controlspp docspp valspp
-            (,,,) (fromIntegral count) <$>
-                peek controlspp <*> peek docspp <*> peek valspp
+    (count, controlsp, docsp) <-
+        alloca $ \controlspp -> alloca $ \docspp -> do
+            count <- c_faust_controls patch controlspp docspp
+            (,,) (fromIntegral count) <$> peek controlspp <*> peek docspp
     controls <- map Control.Control <$> peekTexts count controlsp
     free controlsp
     docs <- peekTexts count docsp
     mapM_ free =<< peekArray count docsp
     free docsp
-    vals <- peekArray count valsp
-    free valsp
-    return $ zip3 controls vals docs
+    return $ zip controls docs
 
--- int faust_controls(Patch patch, const char ***out_controls, char ***out_docs,
---     FAUSTFLOAT ***out_vals)
+-- int faust_controls(
+--     const Patch *patch, const char ***out_controls, char ***out_docs);
 foreign import ccall "faust_controls"
     c_faust_controls :: Patch -> Ptr (Ptr CString) -> Ptr (Ptr CString)
-        -> Ptr (Ptr (Ptr CFloat)) -> IO CInt
+        -> IO CInt
+
+-- | Set UI controls by their index in 'getUiControls'.  This is a single FFI
+-- call, and doesn't need to look up control names.
+setUiControls :: Instrument -> [(Int, Float)] -> IO ()
+setUiControls inst controls =
+    withArray (map (CUtil.c_int . fst) controls) $ \indicesP ->
+    withArray (map (realToFrac . snd) controls) $ \valuesP ->
+        c_faust_set_controls inst indicesP valuesP
+            (CUtil.c_int (length controls))
+
+-- void faust_set_controls(
+--     Patch *patch, const int *indices, const FAUSTFLOAT *values, int n)
+foreign import ccall "faust_set_controls"
+    c_faust_set_controls :: Instrument -> Ptr CInt -> Ptr CFloat -> CInt
+        -> IO ()
 
 withInstrument :: Patch -> (Instrument -> IO a) -> IO a
 withInstrument patch = Exception.bracket (initialize patch) destroy
@@ -205,12 +225,57 @@ patchOutputs = fromIntegral . c_faust_num_outputs
 foreign import ccall "faust_num_inputs" c_faust_num_inputs :: Patch -> CInt
 foreign import ccall "faust_num_outputs" c_faust_num_outputs :: Patch -> CInt
 
+-- | The output lags the controls by this many frames, due to oversampling.
+-- To line it up, render the controls this far ahead of the output, and drop
+-- this much output from a new instrument.
+patchLatency :: Patch -> Audio.Frame
+patchLatency = Audio.Frame . fromIntegral . c_faust_latency
+
+foreign import ccall "faust_latency" c_faust_latency :: Patch -> CInt
+
 -- | Render chunk of time and return samples.  The chunk size is determined by
 -- the input controls, or 'Audio.chunkSize' if there are none.
 render :: Instrument -> [V.Vector Float] -- ^ the length must be equal to the
     -- the patchInputs, and each vector must have the same length
     -> IO [V.Vector Float] -- ^ one chunk of samples for each output channel
-render inst controls = do
+render inst controls = fst <$> renderWith inst controls (c_faust_render inst)
+
+-- void faust_render(
+--     Patch *patch, int frames, const float **controls, float **outputs);
+foreign import ccall "faust_render"
+    c_faust_render :: Instrument -> CInt -> Ptr (Ptr Float) -> Ptr (Ptr Float)
+        -> IO ()
+
+-- | Thresholds for 'renderDetect', in dB.  Output is silent if both RMS and
+-- peak are below their thresholds.
+data Silence = Silence {
+    _rmsDb :: !Float
+    , _peakDb :: !Float
+    } deriving (Eq, Show)
+
+-- | Like 'render', but also analyze the output for silence, in the same FFI
+-- call.
+renderDetect :: Silence
+    -> Audio.Frame -- ^ silent frames leading up to this chunk
+    -> Instrument -> [V.Vector Float]
+    -> IO ([V.Vector Float], Audio.Frame)
+    -- ^ (samples, silent frames at the end of this chunk)
+renderDetect (Silence rmsDb peakDb) (Audio.Frame silent) inst controls =
+    second (Audio.Frame . fromIntegral) <$> renderWith inst controls
+        (\frames controlsP outsP -> c_faust_render_detect inst frames
+            controlsP outsP (realToFrac rmsDb) (realToFrac peakDb)
+            (CUtil.c_int silent))
+
+-- int faust_render_detect(Patch *patch, int frames, const float **controls,
+--     float **outputs, float rms_db, float peak_db, int silent);
+foreign import ccall "faust_render_detect"
+    c_faust_render_detect :: Instrument -> CInt -> Ptr (Ptr Float)
+        -> Ptr (Ptr Float) -> CFloat -> CFloat -> CInt -> IO CInt
+
+renderWith :: Instrument -> [V.Vector Float]
+    -> (CInt -> Ptr (Ptr Float) -> Ptr (Ptr Float) -> IO a)
+    -> IO ([V.Vector Float], a)
+renderWith inst controls cRender = do
     let inputs = patchInputs (asPatch inst)
     unless (length controls == inputs) $
         errorIO $ "instrument has " <> showt inputs
@@ -223,18 +288,12 @@ render inst controls = do
     let outputs = patchOutputs (asPatch inst)
     outFptrs <- mapM Foreign.mallocForeignPtrArray (replicate outputs frames)
     -- Holy manual memory management, Batman.
-    CUtil.withForeignPtrs outFptrs $ \outPtrs ->
+    result <- CUtil.withForeignPtrs outFptrs $ \outPtrs ->
         withPtrs controls $ \controlPs _lens ->
         withArray outPtrs $ \outsP ->
         withArray controlPs $ \controlsP ->
-            c_faust_render inst (CUtil.c_int frames) controlsP outsP
-    return $ map (\fptr -> V.unsafeFromForeignPtr0 fptr frames) outFptrs
-
--- void faust_render(
---     Patch *patch, int frames, const float **controls, float **outputs);
-foreign import ccall "faust_render"
-    c_faust_render :: Instrument -> CInt -> Ptr (Ptr Float) -> Ptr (Ptr Float)
-        -> IO ()
+            cRender (CUtil.c_int frames) controlsP outsP
+    return (map (\fptr -> V.unsafeFromForeignPtr0 fptr frames) outFptrs, result)
 
 withPtrs :: [V.Vector Float] -> ([Ptr Float] -> [Int] -> IO a) -> IO a
 withPtrs vs f = go [] vs
@@ -284,6 +343,144 @@ foreign import ccall "faust_get_state"
 foreign import ccall "faust_put_state"
     c_faust_put_state :: Instrument -> CString -> IO ()
 
+-- * Voices
+
+-- | Several allocated patches, to play overlapping notes.  Each note is
+-- assigned to its own voice, and when it ends, the voice keeps rendering until
+-- it goes silent.  See Voices.h.
+type Voices = Ptr VoicesP
+data VoicesP
+
+-- | Identify a note for 'renderVoices'.  These must increase in note start
+-- order, and be the same across renders since they are saved in the state,
+-- e.g. the index of the note in the score.
+type NoteId = Int
+
+withVoices :: Patch -> Int -> Audio.Frame -> Silence -> Audio.Frame
+    -> (Voices -> IO a) -> IO a
+withVoices patch count maxRelease silence silenceHold =
+    Exception.bracket
+        (initializeVoices patch count maxRelease silence silenceHold)
+        destroyVoices
+
+-- | Allocate the given number of voices.  A voice is freed after its note
+-- ends and it has been silent for silenceHold, or after maxRelease.
+initializeVoices :: Patch -> Int
+    -> Audio.Frame -- ^ maxRelease
+    -> Silence
+    -> Audio.Frame -- ^ silenceHold
+    -> IO Voices
+initializeVoices patch count (Audio.Frame maxRelease) (Silence rmsDb peakDb)
+        (Audio.Frame silenceHold) =
+    c_faust_voices_initialize patch (CUtil.c_int Config.samplingRate)
+        (CUtil.c_int count) (CUtil.c_int maxRelease) (realToFrac rmsDb)
+        (realToFrac peakDb) (CUtil.c_int silenceHold)
+
+-- Voices *faust_voices_initialize(const Patch *patch, int srate, int count,
+--     int max_release, float rms_db, float peak_db, int silence_hold);
+foreign import ccall "faust_voices_initialize"
+    c_faust_voices_initialize :: Patch -> CInt -> CInt -> CInt -> CFloat
+        -> CFloat -> CInt -> IO Voices
+
+destroyVoices :: Voices -> IO ()
+destroyVoices = c_faust_voices_destroy
+
+-- void faust_voices_destroy(Voices *voices);
+foreign import ccall "faust_voices_destroy"
+    c_faust_voices_destroy :: Voices -> IO ()
+
+-- | Render a chunk of the notes active during it, and mix all the voices.
+-- Like 'render', each note's controls must be in 'patchInputs' order, and all
+-- the same length, which is the chunk size.  Notes which aren't present any
+-- more start their release.
+renderVoices :: Patch -> Voices -> Audio.Frame
+    -> [(NoteId, [V.Vector Float])] -> IO [V.Vector Float]
+renderVoices patch voices frames notes =
+    fst <$> renderVoicesWith patch frames notes (c_faust_voices_render voices)
+
+-- void faust_voices_render(Voices *voices, int frames, int notes,
+--     const int *ids, const float **controls, float **outputs);
+foreign import ccall "faust_voices_render"
+    c_faust_voices_render :: Voices -> CInt -> CInt -> Ptr CInt
+        -> Ptr (Ptr Float) -> Ptr (Ptr Float) -> IO ()
+
+-- | Like 'renderVoices', but also analyze the output for silence, like
+-- 'renderDetect'.
+renderVoicesDetect :: Silence
+    -> Audio.Frame -- ^ silent frames leading up to this chunk
+    -> Patch -> Voices -> Audio.Frame -> [(NoteId, [V.Vector Float])]
+    -> IO ([V.Vector Float], Audio.Frame)
+    -- ^ (samples, silent frames at the end of this chunk)
+renderVoicesDetect (Silence rmsDb peakDb) (Audio.Frame silent) patch voices
+        frames notes =
+    second (Audio.Frame . fromIntegral) <$> renderVoicesWith patch frames notes
+        (\framesC notesC idsP controlsP outsP ->
+            c_faust_voices_render_detect voices framesC notesC idsP controlsP
+                outsP (realToFrac rmsDb) (realToFrac peakDb)
+                (CUtil.c_int silent))
+
+-- int faust_voices_render_detect(Voices *voices, int frames, int notes,
+--     const int *ids, const float **controls, float **outputs,
+--     float rms_db, float peak_db, int silent);
+foreign import ccall "faust_voices_render_detect"
+    c_faust_voices_render_detect :: Voices -> CInt -> CInt -> Ptr CInt
+        -> Ptr (Ptr Float) -> Ptr (Ptr Float) -> CFloat -> CFloat -> CInt
+        -> IO CInt
+
+renderVoicesWith :: Patch -> Audio.Frame -> [(NoteId, [V.Vector Float])]
+    -> (CInt -> CInt -> Ptr CInt -> Ptr (Ptr Float) -> Ptr (Ptr Float) -> IO a)
+    -> IO ([V.Vector Float], a)
+renderVoicesWith patch (Audio.Frame frames) notes cRender = do
+    let inputs = patchInputs patch
+    forM_ notes $ \(noteId, controls) -> do
+        unless (length controls == inputs) $
+            errorIO $ "note " <> showt noteId <> ": instrument has "
+                <> showt inputs <> " controls, but was given "
+                <> showt (length controls)
+        unless (all ((== frames) . V.length) controls) $
+            errorIO $ "note " <> showt noteId <> ": expected "
+                <> showt frames <> " frames, got "
+                <> pretty (map V.length controls)
+    let outputs = patchOutputs patch
+    outFptrs <- mapM Foreign.mallocForeignPtrArray (replicate outputs frames)
+    result <- CUtil.withForeignPtrs outFptrs $ \outPtrs ->
+        withPtrs (concatMap snd notes) $ \controlPs _lens ->
+        withArray outPtrs $ \outsP ->
+        withArray controlPs $ \controlsP ->
+        withArray (map (CUtil.c_int . fst) notes) $ \idsP ->
+            cRender (CUtil.c_int frames) (CUtil.c_int (length notes)) idsP
+                controlsP outsP
+    return (map (\fptr -> V.unsafeFromForeignPtr0 fptr frames) outFptrs, result)
+
+-- | Get the state of all voices.  This is always copied, since the C++ side
+-- reuses its buffer.
+getVoicesState :: Voices -> IO Checkpoint.State
+getVoicesState voices = alloca $ \statepp -> do
+    size <- c_faust_voices_get_state voices statepp
+    statep <- peek statepp
+    Checkpoint.State <$> ByteString.packCStringLen (statep, fromIntegral size)
+
+putVoicesState :: Checkpoint.State -> Voices -> IO ()
+putVoicesState (Checkpoint.State state) voices =
+    ByteString.Unsafe.unsafeUseAsCStringLen state $ \(statep, size) -> do
+        let vsize = c_faust_voices_get_state_size voices
+        unless (fromIntegral size == vsize) $
+            errorIO $ "voices " <> showt voices <> " expect state size "
+                <> showt vsize <> " but got " <> showt size
+        c_faust_voices_put_state voices statep
+
+-- size_t faust_voices_get_state_size(const Voices *voices);
+foreign import ccall "faust_voices_get_state_size"
+    c_faust_voices_get_state_size :: Voices -> CSize
+
+-- size_t faust_voices_get_state(Voices *voices, const char **state);
+foreign import ccall "faust_voices_get_state"
+    c_faust_voices_get_state :: Voices -> Ptr CString -> IO CSize
+
+-- void faust_voices_put_state(Voices *voices, const char *state);
+foreign import ccall "faust_voices_put_state"
+    c_faust_voices_put_state :: Voices -> CString -> IO ()
+
 -- * util
 
 peekTexts :: Int -> Ptr CString -> IO [Text]
@@ -63,7 +63,7 @@ main = do
                     forM_ controls $ \(c, cdoc) ->
                         Text.IO.putStrLn $ pretty c <> ": " <> pretty cdoc
                     uiControls <- DriverC.getUiControls patch
-                    forM_ uiControls $ \(c, _, cdoc) ->
+                    forM_ uiControls $ \(c, cdoc) ->
                         Text.IO.putStrLn $ "UI: " <> pretty c <> ": " <> cdoc
             putStrLn ""
         [notesFilename] -> do
@@ -2,6 +2,11 @@
 // This program is distributed under the terms of the GNU General Public
 // License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
 
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+
 #include <faust/gui/CInterface.h>
 #include <faust/gui/UI.h>
 
@@ -27,9 +32,29 @@ Patch::getMetadata() const
     return pairs;
 }
 
+std::vector<std::string>
+Patch::getControls() const
+{
+    // Sort by key, as DriverC does with Map.toAscList.
+    std::vector<std::string> keys;
+    for (const auto &pair : getMetadata()) {
+        if (strncmp(pair.first, "control", 7) == 0)
+            keys.push_back(pair.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::string> controls;
+    for (const std::string &key : keys) {
+        size_t i = key.find('_');
+        controls.push_back(i == std::string::npos ? "" : key.substr(i + 1));
+    }
+    return controls;
+}
+
 
 class StoreUi : public UI {
 public:
+    StoreUi(const Patch::State *state)
+        : base(reinterpret_cast<const char *>(state)) {}
     std::vector<Patch::Widget> widgets;
 
     virtual void openTabBox(const char *label) override {}
@@ -43,31 +68,31 @@ public:
     // -- active widgets
 
     virtual void addButton(const char *label, FAUSTFLOAT *zone) override {
-        widgets.push_back(Patch::Widget(label, zone, true));
+        widgets.push_back(Patch::Widget(label, offset(zone), true));
     }
     virtual void addCheckButton(const char *label, FAUSTFLOAT *zone) override {
-        widgets.push_back(Patch::Widget(label, zone, true));
+        widgets.push_back(Patch::Widget(label, offset(zone), true));
     }
     virtual void addVerticalSlider(const char *label, FAUSTFLOAT *zone,
             FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step)
         override
     {
         widgets.push_back(
-            Patch::Widget(label, zone, false, init, min, max, step));
+            Patch::Widget(label, offset(zone), false, init, min, max, step));
     }
     virtual void addHorizontalSlider(const char *label, FAUSTFLOAT *zone,
             FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step)
         override
     {
         widgets.push_back(
-            Patch::Widget(label, zone, false, init, min, max, step));
+            Patch::Widget(label, offset(zone), false, init, min, max, step));
     }
     virtual void addNumEntry(const char *label, FAUSTFLOAT *zone,
             FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step)
         override
     {
         widgets.push_back(
-            Patch::Widget(label, zone, false, init, min, max, step));
+            Patch::Widget(label, offset(zone), false, init, min, max, step));
     }
 
     // -- passive widgets
@@ -76,21 +101,268 @@ public:
         FAUSTFLOAT min, FAUSTFLOAT max) override {}
     virtual void addVerticalBargraph(const char *label, FAUSTFLOAT *zone,
         FAUSTFLOAT min, FAUSTFLOAT max) override {}
+
+private:
+    size_t offset(const FAUSTFLOAT *zone) const {
+        return reinterpret_cast<const char *>(zone) - base;
+    }
+    const char *base;
 };
 
-std::vector<Patch::Widget>
-Patch::getUiMetadata() const
-{
-    StoreUi ui;
-
-    // UIGlue glue;
-    // glue.uiInterface = &ui;
-    // TODO this is implemented as a struct with a zillion function pointers,
-    // which is not only awkward and annoying, but loses type safety when they
-    // decide to add a new function, which they definitely do.  All this hassle
-    // is not worth it for the GUI signal mechanism, which I don't even like
-    // or want to use.
-    // glue.openTabBoxFun = StoreUi::openTabBox;
-    // this->uiMetadata(&glue);
-    return ui.widgets;
+
+// UIGlue is a struct of function pointers, so these forward each one to
+// StoreUi.  If faust adds a new function, it will be null here, so this has
+// to be updated along with faust.
+
+static UI *
+ui(void *p)
+{
+    return static_cast<UI *>(p);
+}
+
+static void
+openTabBox(void *p, const char *label)
+{
+    ui(p)->openTabBox(label);
+}
+
+static void
+openHorizontalBox(void *p, const char *label)
+{
+    ui(p)->openHorizontalBox(label);
+}
+
+static void
+openVerticalBox(void *p, const char *label)
+{
+    ui(p)->openVerticalBox(label);
+}
+
+static void
+closeBox(void *p)
+{
+    ui(p)->closeBox();
+}
+
+static void
+addButton(void *p, const char *label, FAUSTFLOAT *zone)
+{
+    ui(p)->addButton(label, zone);
+}
+
+static void
+addCheckButton(void *p, const char *label, FAUSTFLOAT *zone)
+{
+    ui(p)->addCheckButton(label, zone);
+}
+
+static void
+addVerticalSlider(void *p, const char *label, FAUSTFLOAT *zone,
+    FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step)
+{
+    ui(p)->addVerticalSlider(label, zone, init, min, max, step);
+}
+
+static void
+addHorizontalSlider(void *p, const char *label, FAUSTFLOAT *zone,
+    FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step)
+{
+    ui(p)->addHorizontalSlider(label, zone, init, min, max, step);
+}
+
+static void
+addNumEntry(void *p, const char *label, FAUSTFLOAT *zone,
+    FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step)
+{
+    ui(p)->addNumEntry(label, zone, init, min, max, step);
+}
+
+static void
+addHorizontalBargraph(void *p, const char *label, FAUSTFLOAT *zone,
+    FAUSTFLOAT min, FAUSTFLOAT max)
+{
+    ui(p)->addHorizontalBargraph(label, zone, min, max);
+}
+
+static void
+addVerticalBargraph(void *p, const char *label, FAUSTFLOAT *zone,
+    FAUSTFLOAT min, FAUSTFLOAT max)
+{
+    ui(p)->addVerticalBargraph(label, zone, min, max);
+}
+
+static void
+addSoundFile(void *p, const char *label, const char *url,
+    Soundfile **sf_zone)
+{
+    ui(p)->addSoundfile(label, url, sf_zone);
+}
+
+static void
+declare(void *p, FAUSTFLOAT *zone, const char *key, const char *value)
+{
+    ui(p)->declare(zone, key, value);
+}
+
+
+// Walk buildUserInterface on a scratch State, to get control offsets.  It
+// doesn't need to be initialized, since buildUserInterface only takes the
+// addresses of its fields.
+std::shared_ptr<const std::vector<Patch::Widget>>
+Patch::findWidgets(size_t size, UiMetadata uiMetadata)
+{
+    std::unique_ptr<State, decltype(&free)> state(
+        static_cast<State *>(calloc(1, size)), free);
+    ASSERT(state != nullptr);
+    StoreUi store(state.get());
+
+    UIGlue glue;
+    glue.uiInterface = static_cast<UI *>(&store);
+    glue.openTabBox = openTabBox;
+    glue.openHorizontalBox = openHorizontalBox;
+    glue.openVerticalBox = openVerticalBox;
+    glue.closeBox = closeBox;
+    glue.addButton = addButton;
+    glue.addCheckButton = addCheckButton;
+    glue.addVerticalSlider = addVerticalSlider;
+    glue.addHorizontalSlider = addHorizontalSlider;
+    glue.addNumEntry = addNumEntry;
+    glue.addHorizontalBargraph = addHorizontalBargraph;
+    glue.addVerticalBargraph = addVerticalBargraph;
+    glue.addSoundFile = addSoundFile;
+    glue.declare = declare;
+    uiMetadata(state.get(), &glue);
+
+    return std::make_shared<const std::vector<Widget>>(
+        std::move(store.widgets));
+}
+
+
+// oversampling
+
+// The decimation filter has this many taps per oversampled frame.  More taps
+// are a sharper cutoff, but cost more CPU.
+enum { taps_per_factor = 32 };
+
+static int
+filter_taps(int oversample)
+{
+    return taps_per_factor * oversample + 1;
+}
+
+
+int
+Patch::latency() const
+{
+    // The filter is symmetric, so its delay is half its length.
+    return oversample == 1 ? 0 : taps_per_factor / 2;
+}
+
+
+static void
+findOversamplePair(void *factor, const char *key, const char *value)
+{
+    if (strcmp(key, "oversample") == 0)
+        *static_cast<int *>(factor) = atoi(value);
+}
+
+// Get the factor from declare oversample "n".  Only 2 and 4 are supported.
+int
+Patch::findOversample(Metadata metadata)
+{
+    int factor = 1;
+    MetaGlue glue;
+    glue.metaInterface = static_cast<void *>(&factor);
+    glue.declare = findOversamplePair;
+    metadata(&glue);
+    if (factor != 1 && factor != 2 && factor != 4) {
+        std::cerr << "faust: ignoring unsupported oversample factor: "
+            << factor << '\n';
+        factor = 1;
+    }
+    return factor;
+}
+
+
+// Return (offset of the filter history, bytes to add to the faust state).
+std::pair<size_t, size_t>
+Patch::historyOffset(size_t size, int oversample, int outputs)
+{
+    if (oversample == 1)
+        return std::make_pair(size, 0);
+    size_t offset = (size + sizeof(float) - 1) / sizeof(float) * sizeof(float);
+    size_t history = sizeof(float) * (filter_taps(oversample) - 1) * outputs;
+    return std::make_pair(offset, offset - size + history);
+}
+
+
+// A lowpass FIR with a cutoff a bit under the original Nyquist, so the
+// decimated output doesn't alias.  This is a Blackman-windowed sinc, with
+// unity gain at DC.
+std::shared_ptr<const std::vector<float>>
+Patch::makeFilter(int oversample)
+{
+    const int taps = filter_taps(oversample);
+    // In cycles per oversampled frame.
+    const double cutoff = 0.45 / oversample;
+    const double center = (taps - 1) / 2.0;
+    std::vector<float> filter(taps);
+    double sum = 0;
+    for (int i = 0; i < taps; i++) {
+        double x = i - center;
+        double sinc = x == 0
+            ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+        double window = 0.42 - 0.5 * cos(2 * M_PI * i / (taps - 1))
+            + 0.08 * cos(4 * M_PI * i / (taps - 1));
+        filter[i] = sinc * window;
+        sum += filter[i];
+    }
+    for (float &c : filter)
+        c /= sum;
+    return std::make_shared<const std::vector<float>>(std::move(filter));
+}
+
+
+// Run the dsp at count * oversample frames.  Controls are held for each
+// oversampled frame rather than interpolated, since they are already smooth
+// and an interpolator would need its own state.  Outputs go through the
+// filter, but only every oversample'th output is computed, which is the
+// polyphase decimator.  The filter delays the output by latency() frames.
+void
+Patch::computeOversampled(int count, const float **inputs, float **outputs)
+{
+    const int up = count * oversample;
+    const int taps = filter->size();
+    const int keep = taps - 1;
+    for (int i = 0; i < this->inputs; i++) {
+        upInputs[i].resize(up);
+        for (int f = 0; f < count; f++) {
+            std::fill(upInputs[i].begin() + f * oversample,
+                upInputs[i].begin() + (f + 1) * oversample, inputs[i][f]);
+        }
+        upIns[i] = upInputs[i].data();
+    }
+    // Leave room for the history in front of the output.
+    for (int c = 0; c < this->outputs; c++) {
+        upOutputs[c].resize(keep + up);
+        upOuts[c] = upOutputs[c].data() + keep;
+    }
+    compute_(state, up, upIns.data(), upOuts.data());
+
+    const float *h = filter->data();
+    for (int c = 0; c < this->outputs; c++) {
+        float *saved = reinterpret_cast<float *>(
+            reinterpret_cast<char *>(state) + history) + c * keep;
+        float *buf = upOutputs[c].data();
+        memcpy(buf, saved, keep * sizeof(float));
+        for (int f = 0; f < count; f++) {
+            // The newest sample for this frame is at keep + f * oversample.
+            const float *x = buf + keep + f * oversample;
+            float sum = 0;
+            for (int k = 0; k < taps; k++)
+                sum += h[k] * x[-k];
+            outputs[c][f] = sum;
+        }
+        memcpy(saved, buf + up, keep * sizeof(float));
+    }
 }
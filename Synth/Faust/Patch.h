@@ -7,6 +7,7 @@
 #include <memory>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -40,49 +41,79 @@ public:
     struct State { double x; };
     typedef void (*Initialize)(State *, int);
     typedef void (*Metadata)(MetaGlue *);
-    typedef void (*UiMetadata)(UIGlue *);
+    typedef void (*UiMetadata)(State *, UIGlue *);
     // TODO input is treated as const, I should fix faust's generated c++.
     typedef void (*Compute)(State *state, int, const float **, float **);
 
+    // 'size' is the size of the faust dsp struct.
     Patch(const char *name, size_t size, int inputs, int outputs,
             Initialize initialize, Metadata metadata, UiMetadata uiMetadata,
             Compute compute_) :
-        name(name), size(size), inputs(inputs), outputs(outputs),
+        name(name), oversample(findOversample(metadata)),
+        size(size + historyOffset(size, oversample, outputs).second),
+        inputs(inputs), outputs(outputs),
         state(nullptr),
         metadata(metadata), uiMetadata(uiMetadata), initialize(initialize),
-        compute_(compute_)
-    {}
+        compute_(compute_), widgets(findWidgets(size, uiMetadata)),
+        history(historyOffset(size, oversample, outputs).first),
+        filter(oversample == 1 ? nullptr : makeFilter(oversample))
+    {
+        if (oversample > 1) {
+            upInputs.resize(inputs);
+            upOutputs.resize(outputs);
+            upIns.resize(inputs);
+            upOuts.resize(outputs);
+        }
+    }
     ~Patch() {
-        delete state;
+        free(state);
     }
 
+    // If oversample > 1, the dsp runs at srate * oversample, but still takes
+    // controls and produces output at srate.
     Patch *allocate(int srate) const {
-        Patch *p = new Patch(
-            name, size, inputs, outputs, initialize, metadata, uiMetadata,
-            compute_);
+        Patch *p = new Patch(*this);
         p->state = static_cast<State *>(calloc(1, size));
         ASSERT(p->state != nullptr);
-        p->initialize(p->state, srate);
+        p->initialize(p->state, srate * oversample);
         return p;
     }
 
     typedef std::vector<std::pair<const char *, const char *>> Pairs;
     Pairs getMetadata() const;
+    // Control names from the control#_name metadata, in input order.  This
+    // should be the same as Synth.Faust.DriverC.getControls.
+    std::vector<std::string> getControls() const;
 
+    // A UI control.  Since the prototype has no state, this records the
+    // control's offset into State, rather than a pointer.
     struct Widget {
-        Widget(const char *label, FAUSTFLOAT *value, bool boolean,
+        Widget(const char *label, size_t offset, bool boolean,
                 FAUSTFLOAT init = 0, FAUSTFLOAT min = 0, FAUSTFLOAT max = 0,
                 FAUSTFLOAT step = 0)
-            : label(label), value(value), boolean(boolean), init(init),
+            : label(label), offset(offset), boolean(boolean), init(init),
                 min(min), max(max), step(step)
             {}
         const char *label;
-        FAUSTFLOAT *value;
+        size_t offset;
         bool boolean;
         FAUSTFLOAT init, min, max, step;
     };
 
-    std::vector<Widget> getUiMetadata() const;
+    // UI controls, in the order of buildUserInterface.  This is computed
+    // once per prototype, and shared with its allocated Patches.
+    const std::vector<Widget> &getUiMetadata() const { return *widgets; }
+
+    // Set UI controls by their index in getUiMetadata.
+    void setControls(const int *indices, const FAUSTFLOAT *values, int n) {
+        ASSERT(state != nullptr);
+        char *base = reinterpret_cast<char *>(state);
+        for (int i = 0; i < n; i++) {
+            ASSERT(0 <= indices[i] && size_t(indices[i]) < widgets->size());
+            *reinterpret_cast<FAUSTFLOAT *>(
+                base + (*widgets)[indices[i]].offset) = values[i];
+        }
+    }
 
     size_t getState(const State **p) const {
         *p = state;
@@ -92,12 +123,25 @@ public:
         memcpy(state, p, size);
     }
 
+    // Frames the output is delayed relative to the inputs.  This is the
+    // oversampling filter's delay, so it's 0 if oversample == 1.  The caller
+    // compensates by giving inputs this far ahead of the output it wants, and
+    // dropping this much output from a newly initialized Patch.
+    int latency() const;
+
     void compute(int count, const float **inputs, float **outputs) {
         ASSERT(state != nullptr);
-        compute_(state, count, inputs, outputs);
+        if (oversample == 1)
+            compute_(state, count, inputs, outputs);
+        else
+            computeOversampled(count, inputs, outputs);
     }
 
     const char *name;
+    // Oversampling factor, from the "oversample" metadata.
+    const int oversample;
+    // Size of the state.  This is the faust dsp struct, plus the decimation
+    // filter history if oversample > 1.
     const size_t size;
     const int inputs, outputs;
 private:
@@ -106,4 +150,27 @@ private:
     UiMetadata uiMetadata;
     Initialize initialize;
     Compute compute_;
+    std::shared_ptr<const std::vector<Widget>> widgets;
+
+    // Oversampling.  The filter history for each output is stored in the
+    // state after the faust struct, at this byte offset, so it's saved with
+    // getState.
+    size_t history;
+    std::shared_ptr<const std::vector<float>> filter;
+    // Scratch buffers for oversampled controls and outputs.  They only grow,
+    // so once they fit the chunk size, rendering doesn't allocate.
+    std::vector<std::vector<float>> upInputs, upOutputs;
+    // Pointers into upInputs and upOutputs, for compute_.
+    std::vector<const float *> upIns;
+    std::vector<float *> upOuts;
+    void computeOversampled(int count, const float **inputs, float **outputs);
+
+    Patch(const Patch &) = default;
+    static std::shared_ptr<const std::vector<Widget>> findWidgets(
+        size_t size, UiMetadata uiMetadata);
+    static int findOversample(Metadata metadata);
+    static std::pair<size_t, size_t> historyOffset(
+        size_t size, int oversample, int outputs);
+    static std::shared_ptr<const std::vector<float>> makeFilter(
+        int oversample);
 };
@@ -7,6 +7,7 @@
 module Synth.Faust.Render where
 import qualified Control.Monad.Trans.Resource as Resource
 import qualified Data.IORef as IORef
+import qualified Data.List as List
 import qualified Data.Map as Map
 import qualified Data.Vector.Storable as V
 
@@ -69,28 +70,40 @@ data Config = Config {
     _chunkSize :: Audio.Frame
     -- | Force an end if the signal hasn't gone to zero before this.
     , _maxDecay :: RealTime
+    -- | After the last note, stop once the output has been below this
+    -- threshold for '_silenceHold'.  A voice is also freed once its release
+    -- has been below it for that long.
+    , _silence :: DriverC.Silence
+    , _silenceHold :: RealTime
+    -- | Number of notes that can sound at once.  Each voice is a separate
+    -- instance of the patch, and all their state goes in each checkpoint.
+    , _voices :: Int
     } deriving (Show)
 
 defaultConfig :: Config
 defaultConfig = Config
     { _chunkSize = Audio.Frame Config.checkpointSize
-    -- TODO it should be longer, but since 'isBasicallySilent' is
-    -- unimplemented every decay lasts this long.
-    , _maxDecay = 2
+    , _maxDecay = 8
+    , _silence = DriverC.Silence { _rmsDb = -84, _peakDb = -72 }
+    , _silenceHold = 0.05
+    , _voices = 4
     }
 
--- | Render notes belonging to a single FAUST patch.  Since they render on
--- a single element, they should either not overlap, or be ok if overlaps
--- cut each other off.
+-- | Render notes belonging to a single FAUST patch.  Each note gets its own
+-- voice, so overlapping notes don't cut each other off, up to '_voices'.
 renderPatch :: DriverC.Patch -> Config -> Maybe Checkpoint.State
     -> (Checkpoint.State -> IO ()) -> [Note.Note] -> RealTime -> Audio
 renderPatch patch config mbState notifyState notes_ start =
     maybe id AUtil.volume vol $ interleave $
-        render patch mbState notifyState inputs
-            (AUtil.toFrame start) (AUtil.toFrame final) config
+        render patch config mbState notifyState inputs
+            (AUtil.toFrame start) (AUtil.toFrame final)
     where
-    inputs = renderControls (_chunkSize config)
-        (filter (/=Control.volume) controls) notes start
+    -- A note's index in the score is its NoteId, so it stays the same when
+    -- rendering resumes from a checkpoint.
+    inputs = noteInputs (_chunkSize config) (DriverC.patchLatency patch)
+        (filter (/=Control.volume) controls)
+        (inputStart patch mbState (AUtil.toFrame start))
+        (zip [0..] notes_)
     controls = DriverC.getControls patch
     vol = renderControl (_chunkSize config) notes start Control.volume
     final = maybe 0 Note.end (Seq.last notes)
@@ -103,67 +116,129 @@ interleave naudio = case Audio.interleaved naudio of
     -- have been verified by DriverC.getParsedMetadata.
     Left err -> Audio.throw $ "expected 1 or 2 outputs: " <> err
 
+-- | Each chunk of 'render' input is its length, and the controls of each note
+-- that sounds during it.
+type NoteInputs m =
+    S.Stream (S.Of (Audio.Frame, [(DriverC.NoteId, [V.Vector Audio.Sample])]))
+        m ()
+
+-- | Where the 'render' @inputs@ start.  The output lags the inputs by
+-- 'DriverC.patchLatency', so they are always that far ahead.  A saved state
+-- was already caught up to that, but new voices start that far before the
+-- output, and render drops what they produce before it.
+inputStart :: DriverC.Patch -> Maybe Checkpoint.State -> Audio.Frame
+    -> Audio.Frame
+inputStart patch mbState start = case mbState of
+    Nothing -> start
+    Just _ -> start + DriverC.patchLatency patch
+
 -- | Render a FAUST instrument incrementally.
 --
--- Chunk size is determined by the size of the @inputs@ chunks, or
--- Audio.chunkSize if they're empty or run out.  The inputs will go to zero
--- if they end before the given time.
-render :: DriverC.Patch -> Maybe Checkpoint.State
+-- Chunk size is determined by the @inputs@, which go on forever, so this
+-- stops at the logical end, plus decay.  They should start at 'inputStart'.
+render :: DriverC.Patch -> Config -> Maybe Checkpoint.State
     -> (Checkpoint.State -> IO ()) -- ^ notify new state after each audio chunk
-    -> NAudio -> Audio.Frame -> Audio.Frame -- ^ logical end time
-    -> Config -> NAudio
-render patch mbState notifyState inputs start end config =
+    -> NoteInputs (Resource.ResourceT IO) -> Audio.Frame
+    -> Audio.Frame -- ^ logical end time
+    -> NAudio
+render patch config mbState notifyState inputs start end =
     Audio.NAudio (DriverC.patchOutputs patch) $ do
-        (key, inst) <- lift $
-            Resource.allocate (DriverC.initialize patch) DriverC.destroy
-        liftIO $ whenJust mbState $ \state -> DriverC.putState state inst
-        let nstream = Audio._nstream (Audio.zeroPadN (_chunkSize config) inputs)
-        Audio.loop1 (start, nstream) $ \loop (start, inputs) -> do
-            -- Audio.zeroPadN should have made this infinite.
-            (controls, nextInputs) <-
+        (key, voices) <- lift $ Resource.allocate
+            (DriverC.initializeVoices patch (_voices config) maxDecay
+                (_silence config) silenceHold)
+            DriverC.destroyVoices
+        liftIO $ whenJust mbState $ \state ->
+            DriverC.putVoicesState state voices
+        let now = inputStart patch mbState start - DriverC.patchLatency patch
+        Audio.loop1 (now, 0, inputs) $ \loop (now, silent, inputs) -> do
+            (input, nextInputs) <-
                 maybe (CallStack.errorIO "end of endless stream") return
                     =<< lift (S.uncons inputs)
-            result <- render1 inst controls start
+            result <- render1 voices input now silent
             case result of
                 Nothing -> Resource.release key
-                Just nextStart -> loop (nextStart, nextInputs)
+                Just (next, nextSilent) -> loop (next, nextSilent, nextInputs)
         where
-        render1 inst controls start
-            | start >= end + maxDecay = return Nothing
+        -- 'now' is the output frame, which lags the inputs by the latency.
+        render1 voices (frames, notes) now silent
+            | now >= end + maxDecay = return Nothing
+            | now < start = do
+                -- New voices catching up to the latency.  noteInputs doesn't
+                -- let a chunk cross start, so this is all before it.
+                liftIO $ void $ DriverC.renderVoices patch voices frames notes
+                return $ Just (now + frames, silent)
             | otherwise = do
-                outputs <- liftIO $ DriverC.render inst controls
-                -- XXX Since this uses unsafeGetState, readers of notifyState
-                -- have to entirely use the state before returning.  See
-                -- Checkpoint.getFilename and Checkpoint.writeBs.
-                liftIO $ notifyState =<< DriverC.unsafeGetState inst
+                (outputs, nextSilent) <- liftIO $
+                    DriverC.renderVoicesDetect (_silence config) silent patch
+                        voices frames notes
+                liftIO $ notifyState =<< DriverC.getVoicesState voices
                 S.yield outputs
                 case outputs of
                     [] -> CallStack.errorIO "dsp with 0 outputs"
-                    output : _
-                        | frames == 0 || chunkEnd >= end + maxDecay
-                                || chunkEnd >= end
-                                    && isBasicallySilent output ->
-                            return Nothing
-                        | otherwise -> return $ Just chunkEnd
-                        where
-                        chunkEnd = start + frames
-                        frames = Audio.Frame $ V.length output
+                    _ | chunkEnd >= end + maxDecay
+                            || chunkEnd >= end
+                                && nextSilent >= silenceHold ->
+                        return Nothing
+                      | otherwise -> return $ Just (chunkEnd, nextSilent)
+                where chunkEnd = now + frames
         maxDecay = AUtil.toFrame $ _maxDecay config
+        silenceHold = AUtil.toFrame $ _silenceHold config
 
-isBasicallySilent :: V.Vector Audio.Sample -> Bool
-isBasicallySilent _samples = False -- TODO RMS < -n dB
-
--- | Render the supported controls down to audio rate signals.  This causes the
--- stream to be synchronized by 'Config.chunkSize', which should determine
--- 'render' chunk sizes, which should be a factor of Config.checkpointSize.
-renderControls :: Audio.Frame -> [Control.Control]
+-- | Break notes into 'render' input chunks, starting at the given frame.
+-- A chunk is normally chunkSize, but it's split wherever a note starts or
+-- ends, so each note is present for exactly its duration.  The chunks end on
+-- multiples of chunkSize plus the latency, so the output, which lags by the
+-- latency, still lines up with checkpoints.  A note with no duration sounds
+-- for one frame, or it would never be seen.  The stream goes on forever.
+noteInputs :: Monad m => Audio.Frame -> Audio.Frame -> [Control.Control]
     -- ^ controls expected by the instrument, in the expected order
-    -> [Note.Note] -> RealTime -> NAudio
-renderControls chunkSize controls notes start =
-    Audio.nonInterleaved now chunkSize $
-        map (fromMaybe Audio.silence1 . renderControl chunkSize notes start)
-            controls
-    where now = 0 -- for the moment, faust always starts at 0
+    -> Audio.Frame -> [(DriverC.NoteId, Note.Note)] -> NoteInputs m
+noteInputs chunkSize latency controls start = go start [] [] . map range
+    where
+    range (noteId, note) = (noteId, note, s, max (s+1) e)
+        where
+        s = AUtil.toFrame (Note.start note)
+        e = AUtil.toFrame (Note.end note)
+    -- A voice with no gate stops rendering 'latency' after its note ends, so
+    -- split there too.  See Voices.h.
+    go now playing flushes notes = do
+        let (starting, waiting) = span (\(_, _, s, _) -> s <= now) notes
+            started = playing ++
+                [ (noteId, e, noteControls controls now note)
+                | (noteId, note, _, e) <- starting, e > now
+                ]
+            chunkEnd = latency
+                + ((now - latency) `div` chunkSize + 1) * chunkSize
+            next = minimum $ chunkEnd : [e | (_, e, _) <- started]
+                ++ flushes ++ [s | (_, _, s, _) <- take 1 waiting]
+        splits <- lift $ forM started $ \(noteId, e, audios) -> do
+            (chunks, rest) <- unzip <$> mapM (Audio.splitAt (next - now)) audios
+            return ((noteId, map mconcat chunks), (noteId, e, rest))
+        S.yield (next - now, map fst splits)
+        let (continuing, ended) =
+                List.partition (\(_, e, _) -> e > next) (map snd splits)
+        go next continuing
+            (filter (>next) $ flushes
+                ++ [e + latency | latency > 0, (_, e, _) <- ended])
+            waiting
+
+-- | Render a note's controls, starting at the given frame.  The gate is
+-- always 1, since a note is only given to 'render' while it's playing.
+noteControls :: Monad m => [Control.Control] -> Audio.Frame -> Note.Note
+    -> [Audio.Audio m Config.SamplingRate 1]
+noteControls controls start note = map get controls
+    where
+    get control
+        | control == Control.gate = Audio.constant 1
+        | otherwise = maybe Audio.silence1 (Audio.linear . breakpoints) $
+            Map.lookup control (Note.controls note)
+    -- Like 'controlBreakpoints', an empty signal is 0.
+    breakpoints signal =
+        map (first (subtract offset . RealTime.to_seconds)) $
+            if null bps then [(Note.start note, 0)] else bps
+        where
+        bps = Signal.to_pairs $ Signal.clip_before (Note.start note) signal
+    offset = RealTime.to_seconds (AUtil.toSeconds start)
 
 renderControl :: (Monad m, TypeLits.KnownNat rate)
     => Audio.Frame -> [Note.Note] -> RealTime -> Control.Control
@@ -4,6 +4,7 @@
 
 module Synth.Faust.Render_test where
 import qualified Control.Monad.Trans.Resource as Resource
+import qualified Data.ByteString as ByteString
 import qualified Data.List as List
 import qualified Data.Map as Map
 import qualified Data.Vector.Storable as Vector
@@ -53,9 +54,13 @@ test_write_incremental = do
     states <- filter (".state." `List.isInfixOf`) <$>
         Directory.listDirectory (dir </> Checkpoint.cacheDir)
     -- All of them have states, since they are at the end of each chunk.
+    stateSize <- withVoices patch (Render._voices config) $
+        fmap (\(Checkpoint.State bytes) ->
+                fromIntegral (ByteString.length bytes))
+            . DriverC.getVoicesState
     io_equal (mapM (Directory.getFileSize
             . ((dir </> Checkpoint.cacheDir) </>)) states)
-        [40, 40, 40]
+        [stateSize, stateSize, stateSize]
 
     let skipCheckpoints = Checkpoint.skipCheckpoints dir
             . Checkpoint.noteHashes (Render._chunkSize config)
@@ -110,6 +115,58 @@ test_write_incremental_offset = do
     equal (take 4 samples) (replicate 4 0)
     -- TODO also test checkpoints are lined up right
 
+test_write_silence = do
+    -- Rendering stops once the output is silent, not at _maxDecay.
+    patch <- getPatch
+    let conf = Render.defaultConfig
+            { Render._chunkSize = 64
+            , Render._maxDecay = 1
+            , Render._silenceHold = 0.01
+            }
+    let note = Note.withControl Control.dynamic
+            (Signal.from_pairs [(0, 1), (0.1, 1), (0.1, 0)]) $
+            mkNote 0 0.1 NN.c4
+    samples <- toSamples $
+        Render.renderPatch patch conf Nothing (const (return ())) [note] 0
+    let frames = length samples
+    check ("stopped early: " <> showt frames) $
+        frames < fromIntegral (AUtil.toFrame 0.2)
+    check ("held for silenceHold: " <> showt frames) $
+        frames >= fromIntegral (AUtil.toFrame 0.11)
+
+test_write_overlap = do
+    -- Overlapping notes each get their own voice, so the output is the same
+    -- as rendering them separately.
+    patch <- getPatch
+    let conf = config { Render._chunkSize = 16 }
+        render notes = toSamples $
+            Render.renderPatch patch conf Nothing (const (return ())) notes 0
+    let dur = AUtil.toSeconds 24
+        note1 = mkNote 0 dur NN.c4
+        note2 = mkNote (AUtil.toSeconds 8) dur NN.e4
+    both <- render [note1, note2]
+    sep1 <- render [note1]
+    sep2 <- render [note2]
+    equal (length both) (length sep2)
+    equal both (zipWith (+) (sep1 ++ repeat 0) sep2)
+
+test_write_oversample = do
+    -- The oversampling filter's delay is compensated, so an impulse comes out
+    -- at the same frame with and without it.
+    patches <- DriverC.getPatches
+    let peak name = do
+            let patch = fromMaybe (error $ "no patch: " <> show name) $
+                    Map.lookup name patches
+            samples <- toSamples $ Render.renderPatch patch config Nothing
+                (const (return ()))
+                [mkNote (AUtil.toSeconds 40) (AUtil.toSeconds 40) NN.c4] 0
+            -- Samples are interleaved stereo, so take the left channel.
+            let left = map snd $ filter (even . fst) $ zip [0 :: Int ..] samples
+            return $ snd $ maximum
+                [(abs s, i) | (i, s) <- zip [0 :: Int ..] left]
+    io_equal (peak "impulse") 40
+    io_equal (peak "impulse_oversample") 40
+
 -- TODO test volume and dyn
 
 renderSamples :: DriverC.Patch -> [Note.Note] -> IO [Float]
@@ -126,11 +183,15 @@ listWavs = fmap (List.sort . filter (".wav" `List.isSuffixOf`))
     . Directory.listDirectory
 
 config :: Render.Config
-config = Render.Config
-    { _chunkSize = 8
-    , _maxDecay = 0
+config = Render.defaultConfig
+    { Render._chunkSize = 8
+    , Render._maxDecay = 0
     }
 
+withVoices :: DriverC.Patch -> Int -> (DriverC.Voices -> IO a) -> IO a
+withVoices patch count = DriverC.withVoices patch count 0
+    (Render._silence config) (AUtil.toFrame (Render._silenceHold config))
+
 getPatch :: IO DriverC.Patch
 getPatch = do
     patches <- DriverC.getPatches
@@ -153,6 +214,78 @@ toSamples = fmap (concatMap Vector.toList) . Resource.runResourceT
     . Audio.toSamples
 
 
+-- * voices
+
+test_renderVoices = do
+    patch <- getPatch
+    let frames = 16
+        render voices = DriverC.renderVoices patch voices frames
+        controls nn =
+            [ Vector.replicate 16 (if c == Control.pitch then nn else 1)
+            | c <- DriverC.getControls patch
+            ]
+        c4 = controls 60
+        e4 = controls 64
+    [a1, a2] <- withVoices patch 2 $ \v ->
+        mapM (render v) [[(0, c4)], [(0, c4)]]
+    [b1, b2] <- withVoices patch 2 $ \v ->
+        mapM (render v) [[], [(1, e4)]]
+    [m1, m2, m3] <- withVoices patch 2 $ \v ->
+        mapM (render v) [[(0, c4)], [(0, c4), (1, e4)], []]
+    equal b1 [Vector.replicate 16 0]
+    equal m1 a1
+    -- The second note gets its own voice, so they mix.
+    equal m2 (zipWith (Vector.zipWith (+)) a2 b2)
+    -- sine has no gate, so there's no release once the notes are gone.
+    equal m3 [Vector.replicate 16 0]
+
+    -- With one voice, the second note steals the first, and the first
+    -- doesn't get it back.
+    [s1, s2, s3] <- withVoices patch 1 $ \v ->
+        mapM (render v) [[(0, c4)], [(0, c4), (1, e4)], [(0, c4)]]
+    equal s1 a1
+    check "stolen" $ s2 /= m2
+    equal s3 [Vector.replicate 16 0]
+
+test_voicesState = do
+    -- Putting the state back resumes exactly where it left off.
+    patch <- getPatch
+    let render voices = DriverC.renderVoices patch voices 16
+        controls nn =
+            [ Vector.replicate 16 (if c == Control.pitch then nn else 1)
+            | c <- DriverC.getControls patch
+            ]
+        chunks =
+            [ [(0, controls 60)]
+            , [(0, controls 60), (1, controls 64)]
+            , [(1, controls 64), (2, controls 67)]
+            ]
+    (state, expected) <- withVoices patch 2 $ \v -> do
+        mapM_ (render v) (take 2 chunks)
+        state <- DriverC.getVoicesState v
+        (,) state <$> render v (chunks !! 2)
+    resumed <- withVoices patch 2 $ \v -> do
+        DriverC.putVoicesState state v
+        render v (chunks !! 2)
+    equal resumed expected
+    -- A fresh voice set doesn't know about note 1.
+    fresh <- withVoices patch 2 $ \v -> render v (chunks !! 2)
+    check "different without state" $ fresh /= expected
+
+test_voicesRelease = do
+    -- Even with 1 frame chunks, a voice isn't freed until its note has made
+    -- it through the oversampling filter.
+    patches <- DriverC.getPatches
+    let patch = fromMaybe (error "no impulse_oversample") $
+            Map.lookup "impulse_oversample" patches
+        render voices = DriverC.renderVoices patch voices 1
+    samples <- withVoices patch 1 $ \v -> mapM (render v) $
+        [(0, [Vector.singleton 1])] : replicate 40 []
+    let left = map (Vector.head . head) samples
+    equal (snd $ maximum [(abs s, i) | (i, s) <- zip [0..] left])
+        (DriverC.patchLatency patch)
+
+
 -- * render
 
 test_gateBreakpoints = do
@@ -0,0 +1,274 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "Voices.h"
+
+
+// silent_frames analyzes silence in blocks of this size.
+enum { silence_block = 256 };
+
+static float
+db_to_amp(float db)
+{
+    return powf(10, db / 20);
+}
+
+int
+silent_frames(int channels, int frames, float **outputs,
+    float rms_db, float peak_db, int silent)
+{
+    // With no outputs, there's nothing to hear.
+    if (channels == 0)
+        return silent + frames;
+    // Compare mean square to avoid the sqrt.
+    const float max_square = powf(db_to_amp(rms_db), 2);
+    const float max_peak = db_to_amp(peak_db);
+    for (int start = 0; start < frames; start += silence_block) {
+        int end = std::min(frames, start + silence_block);
+        float sum = 0, peak = 0;
+        for (int c = 0; c < channels; c++) {
+            for (int i = start; i < end; i++) {
+                float sample = outputs[c][i];
+                sum += sample * sample;
+                peak = std::max(peak, fabsf(sample));
+            }
+        }
+        float square = sum / ((end - start) * channels);
+        if (square < max_square && peak < max_peak)
+            silent += end - start;
+        else
+            silent = 0;
+    }
+    return silent;
+}
+
+
+Voices::Voices(const Patch *patch, int srate, int count, int maxRelease,
+        float rmsDb, float peakDb, int silenceHold) :
+    patch(patch), count(count), maxRelease(maxRelease),
+    rmsDb(rmsDb), peakDb(peakDb), silenceHold(silenceHold), voices(count),
+    gate(-1), lastNote(-1),
+    holdBufs(patch->inputs), voiceBufs(patch->outputs),
+    held(patch->inputs), bufs(patch->outputs)
+{
+    ASSERT(count > 0);
+    // There are usually no more notes in a chunk than voices.
+    order.reserve(count);
+    assigned.reserve(count);
+    for (Voice &voice : voices) {
+        voice.patch.reset(patch->allocate(srate));
+        voice.note = -1;
+        voice.released = -1;
+        voice.silent = 0;
+        voice.held.resize(patch->inputs);
+    }
+    std::vector<std::string> controls(patch->getControls());
+    for (size_t i = 0; i < controls.size(); i++) {
+        if (controls[i] == "gate")
+            gate = i;
+    }
+}
+
+
+int
+Voices::active() const
+{
+    int n = 0;
+    for (const Voice &voice : voices) {
+        if (voice.note != -1)
+            n++;
+    }
+    return n;
+}
+
+
+// Find a voice for a new note.  This always succeeds, but it may steal
+// a voice from another note.
+int
+Voices::allocate()
+{
+    int releasing = -1, oldest = -1;
+    for (int i = 0; i < count; i++) {
+        const Voice &voice = voices[i];
+        if (voice.note == -1)
+            return i;
+        if (voice.released >= 0) {
+            if (releasing == -1
+                    || voice.released > voices[releasing].released)
+                releasing = i;
+        } else if (oldest == -1 || voice.note < voices[oldest].note) {
+            oldest = i;
+        }
+    }
+    return releasing != -1 ? releasing : oldest;
+}
+
+
+void
+Voices::render(int frames, int notes, const int *ids,
+    const float **controls, float **outputs)
+{
+    for (int c = 0; c < patch->outputs; c++)
+        memset(outputs[c], 0, frames * sizeof(float));
+    for (int i = 0; i < patch->inputs; i++)
+        holdBufs[i].resize(frames);
+    for (int c = 0; c < patch->outputs; c++) {
+        voiceBufs[c].resize(frames);
+        bufs[c] = voiceBufs[c].data();
+    }
+
+    // Voices whose notes aren't here any more start releasing.  Without
+    // a gate, there's no release, so they're done once the filter is flushed.
+    for (Voice &voice : voices) {
+        if (voice.note != -1 && voice.released < 0
+                && std::find(ids, ids + notes, voice.note) == ids + notes)
+        {
+            if (gate == -1 && patch->latency() == 0)
+                voice.note = -1;
+            else {
+                voice.released = 0;
+                voice.silent = 0;
+            }
+        }
+    }
+
+    // Assign notes to voices, in id order so stealing is deterministic.
+    order.resize(notes);
+    for (int n = 0; n < notes; n++)
+        order[n] = n;
+    std::sort(order.begin(), order.end(),
+        [ids](int a, int b) { return ids[a] < ids[b]; });
+    assigned.assign(notes, -1);
+    for (int n : order) {
+        for (int i = 0; i < count; i++) {
+            if (voices[i].note == ids[n]) {
+                assigned[n] = i;
+                break;
+            }
+        }
+        if (assigned[n] == -1 && ids[n] > lastNote) {
+            int i = allocate();
+            // If I stole a note that is also in this chunk, it's gone now.
+            for (int m = 0; m < notes; m++) {
+                if (assigned[m] == i)
+                    assigned[m] = -1;
+            }
+            voices[i].note = ids[n];
+            voices[i].released = -1;
+            assigned[n] = i;
+            lastNote = ids[n];
+        }
+    }
+
+    for (int n = 0; n < notes; n++) {
+        if (assigned[n] == -1)
+            continue;
+        Voice &voice = voices[assigned[n]];
+        const float **noteControls = controls + n * patch->inputs;
+        renderVoice(voice, frames, noteControls, outputs);
+        if (frames > 0) {
+            for (int i = 0; i < patch->inputs; i++)
+                voice.held[i] = noteControls[i][frames - 1];
+        }
+    }
+
+    for (Voice &voice : voices) {
+        if (voice.note == -1 || voice.released < 0)
+            continue;
+        for (int i = 0; i < patch->inputs; i++) {
+            float val = i == gate ? 0 : voice.held[i];
+            std::fill(holdBufs[i].begin(), holdBufs[i].end(), val);
+            held[i] = holdBufs[i].data();
+        }
+        renderVoice(voice, frames, held.data(), outputs);
+        // Until latency frames after the release, the output is still
+        // catching up to the note, so it may be silent but not done.
+        if (voice.released >= patch->latency()) {
+            voice.silent = silent_frames(patch->outputs, frames, bufs.data(),
+                rmsDb, peakDb, voice.silent);
+        }
+        voice.released += frames;
+        if (voice.silent >= silenceHold || voice.released >= maxRelease
+            || (gate == -1 && voice.released >= patch->latency()))
+        {
+            voice.note = -1;
+            voice.released = -1;
+        }
+    }
+}
+
+
+// Render a voice into voiceBufs, and mix it into outputs.
+void
+Voices::renderVoice(Voice &voice, int frames, const float **controls,
+    float **outputs)
+{
+    voice.patch->compute(frames, controls, bufs.data());
+    for (int c = 0; c < patch->outputs; c++) {
+        for (int f = 0; f < frames; f++)
+            outputs[c][f] += bufs[c][f];
+    }
+}
+
+
+// The state is lastNote, then for each voice: note, released, silent, held,
+// and the patch state.
+
+size_t
+Voices::stateSize() const
+{
+    size_t voice = sizeof(int32_t) * 3 + sizeof(float) * patch->inputs
+        + patch->size;
+    return sizeof(int32_t) + voice * count;
+}
+
+
+size_t
+Voices::getState(const char **p)
+{
+    stateBuf.resize(stateSize());
+    char *out = stateBuf.data();
+    memcpy(out, &lastNote, sizeof(int32_t));
+    out += sizeof(int32_t);
+    for (const Voice &voice : voices) {
+        memcpy(out, &voice.note, sizeof(int32_t));
+        out += sizeof(int32_t);
+        memcpy(out, &voice.released, sizeof(int32_t));
+        out += sizeof(int32_t);
+        memcpy(out, &voice.silent, sizeof(int32_t));
+        out += sizeof(int32_t);
+        memcpy(out, voice.held.data(), sizeof(float) * patch->inputs);
+        out += sizeof(float) * patch->inputs;
+        const Patch::State *state;
+        size_t size = voice.patch->getState(&state);
+        memcpy(out, state, size);
+        out += size;
+    }
+    *p = stateBuf.data();
+    return stateBuf.size();
+}
+
+
+void
+Voices::putState(const char *p)
+{
+    memcpy(&lastNote, p, sizeof(int32_t));
+    p += sizeof(int32_t);
+    for (Voice &voice : voices) {
+        memcpy(&voice.note, p, sizeof(int32_t));
+        p += sizeof(int32_t);
+        memcpy(&voice.released, p, sizeof(int32_t));
+        p += sizeof(int32_t);
+        memcpy(&voice.silent, p, sizeof(int32_t));
+        p += sizeof(int32_t);
+        memcpy(voice.held.data(), p, sizeof(float) * patch->inputs);
+        p += sizeof(float) * patch->inputs;
+        voice.patch->putState(reinterpret_cast<const Patch::State *>(p));
+        p += patch->size;
+    }
+}
@@ -0,0 +1,105 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "Patch.h"
+
+
+// Play overlapping notes on a monophonic Patch.
+//
+// A faust patch takes a single set of control signals, so overlapping notes
+// on the same Patch cut each other off.  This allocates a fixed number of
+// Patches, one per voice, and assigns notes to them.  When a note ends, its
+// voice keeps rendering with the note's last control values and the gate
+// set to 0, until it goes silent or maxRelease frames pass.  It's silent
+// once silent_frames says so for silenceHold frames in a row, not counting
+// the first Patch::latency frames, which are still the note coming out of
+// the oversampling filter.  Then the voice is free for another note.  A patch with no gate control has no way to know
+// its note ended, so its voice is freed as soon as the note is gone, except
+// that it first renders Patch::latency frames to flush the note out of the
+// oversampling filter.  If no voice is free, the voice with the longest
+// release is stolen, and if nothing is releasing, the oldest note is stolen.
+// Stealing doesn't reset the patch state, so it's like a legato transition.
+//
+// Notes are identified by an int id.  Since stealing the oldest note depends
+// on comparing ids, they must increase in note start order.  Since ids are
+// saved in the state, they must also be the same across renders, e.g. the
+// note's index in the score.
+class Voices {
+public:
+    Voices(const Patch *patch, int srate, int count, int maxRelease,
+        float rmsDb, float peakDb, int silenceHold);
+
+    // Render a chunk.  There are 'notes' notes active during this chunk, each
+    // with an id in 'ids', and patch->inputs control signals in 'controls', so
+    // controls[note * patch->inputs + input].  All the voices are mixed into
+    // 'outputs', which has patch->outputs channels.
+    void render(int frames, int notes, const int *ids,
+        const float **controls, float **outputs);
+
+    // Serialize all voices, including their patch state, into an internal
+    // buffer, which is valid until the next call to getState.
+    size_t getState(const char **p);
+    // The state must have been produced by Voices with the same patch and
+    // count.
+    void putState(const char *p);
+    // The size is constant for a given patch and count.
+    size_t stateSize() const;
+
+    // Number of voices currently playing or releasing.
+    int active() const;
+
+    const Patch *patch;
+    const int count;
+    const int maxRelease;
+    // Silence thresholds for a releasing voice, as in silent_frames.
+    const float rmsDb, peakDb;
+    const int silenceHold;
+
+private:
+    struct Voice {
+        std::unique_ptr<Patch> patch;
+        // Note id, or -1 if this voice is free.
+        int32_t note;
+        // If >=0, the note has ended and this is the frames since then.
+        int32_t released;
+        // Consecutive silent frames during the release.
+        int32_t silent;
+        // Last control values of the note, to hold during release.
+        std::vector<float> held;
+    };
+    int allocate();
+    void renderVoice(Voice &voice, int frames, const float **controls,
+        float **outputs);
+
+    std::vector<Voice> voices;
+    // Index of the gate control, or -1 if the patch has none.
+    int gate;
+    // Highest note id ever allocated.  Notes at or below this which don't
+    // have a voice have been stolen, and shouldn't be allocated again.
+    int32_t lastNote;
+
+    // Scratch space, reused across render calls.
+    std::vector<std::vector<float>> holdBufs;
+    std::vector<std::vector<float>> voiceBufs;
+    std::vector<char> stateBuf;
+    // Notes in id order, and the voice for each note, or -1 if it has none.
+    std::vector<int> order, assigned;
+    // Pointers into holdBufs and voiceBufs.
+    std::vector<const float *> held;
+    std::vector<float *> bufs;
+};
+
+
+// Return the number of silent frames at the end of 'outputs', which continue
+// 'silent' frames from the previous chunk.  It's analyzed in blocks, and a
+// block is silent if its RMS is below rms_db and its peak is below peak_db,
+// in dB relative to 1.
+int silent_frames(int channels, int frames, float **outputs,
+    float rms_db, float peak_db, int silent);
@@ -0,0 +1,156 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// Benchmark the CPU cost of every faust patch.
+//
+// Each patch from all_patches is initialized at SAMPLING_RATE and rendered
+// for a fixed duration with synthetic controls.  Results are written as JSON
+// on stdout, so they can be saved and compared across faust upgrades or dsp
+// edits.
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#include "Patch.h"
+#include "Synth/Shared/config.h"
+#include "driver.h"
+#include "fltk/bench.h"
+
+enum { block_size = 512 };
+// Iterations for the getState/putState measurement.
+enum { state_iterations = 1000 };
+
+
+// Synthesize a control, based on its name.  The gate is periodically
+// retriggered so percussive patches don't decay to silence, pitch is in
+// NoteNumber, and everything else is a constant.
+static float
+synthesize(const std::string &control, int frame)
+{
+    if (control == "gate") {
+        // Half a second on, half a second off.
+        return (frame / (SAMPLING_RATE / 2)) % 2 == 0 ? 1 : 0;
+    } else if (control == "pitch") {
+        // Move around a bit, once per second.
+        static const float pitches[] = { 48, 55, 60, 64, 67 };
+        return pitches[(frame / SAMPLING_RATE) % 5];
+    } else if (control == "dyn") {
+        return 0.75;
+    } else {
+        return 0.5;
+    }
+}
+
+
+static std::string
+json_string(const char *s)
+{
+    std::string out = "\"";
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            out += '\\';
+        out += *s;
+    }
+    return out + '"';
+}
+
+
+static void
+bench(std::ostream &out, const Patch *proto, double seconds)
+{
+    std::vector<std::string> names(proto->getControls());
+    // Instruments with mismatched metadata are rejected by
+    // DriverC.getParsedMetadata, but I can still run them.
+    names.resize(proto->inputs);
+
+    std::vector<std::vector<float>> control_bufs(
+        proto->inputs, std::vector<float>(block_size));
+    std::vector<std::vector<float>> output_bufs(
+        proto->outputs, std::vector<float>(block_size));
+    std::vector<const float *> controls(proto->inputs);
+    std::vector<float *> outputs(proto->outputs);
+    for (int i = 0; i < proto->inputs; i++)
+        controls[i] = control_bufs[i].data();
+    for (int i = 0; i < proto->outputs; i++)
+        outputs[i] = output_bufs[i].data();
+
+    BenchTimer timer;
+    std::unique_ptr<Patch> patch(proto->allocate(SAMPLING_RATE));
+    double init_ns = timer.ns();
+
+    // Controls are synthesized outside of the timed section.
+    const int total = seconds * SAMPLING_RATE;
+    double render_ns = 0;
+    for (int frame = 0; frame < total; frame += block_size) {
+        int frames = std::min(int(block_size), total - frame);
+        for (int i = 0; i < proto->inputs; i++) {
+            for (int j = 0; j < frames; j++)
+                control_bufs[i][j] = synthesize(names[i], frame + j);
+        }
+        timer.lap_ns();
+        patch->compute(frames, controls.data(), outputs.data());
+        render_ns += timer.lap_ns();
+    }
+
+    // This is the same thing DriverC.getState and putState do: copy out, and
+    // copy back in.
+    std::vector<char> saved(patch->size);
+    timer.lap_ns();
+    for (int i = 0; i < state_iterations; i++) {
+        const Patch::State *state;
+        size_t size = patch->getState(&state);
+        memcpy(saved.data(), state, size);
+    }
+    double get_state_ns = timer.lap_ns() / state_iterations;
+    for (int i = 0; i < state_iterations; i++)
+        patch->putState((const Patch::State *) saved.data());
+    double put_state_ns = timer.lap_ns() / state_iterations;
+
+    out << "{\"name\": " << json_string(proto->name)
+        << ", \"inputs\": " << proto->inputs
+        << ", \"outputs\": " << proto->outputs
+        << ", \"oversample\": " << proto->oversample
+        << ", \"frames\": " << total
+        << ", \"init_ns\": " << init_ns
+        << ", \"ns_per_sample\": " << (total ? render_ns / total : 0)
+        << ", \"realtime_factor\": "
+            << (render_ns > 0 ? seconds * 1e9 / render_ns : 0)
+        << ", \"state_size\": " << proto->size
+        << ", \"get_state_ns\": " << get_state_ns
+        << ", \"put_state_ns\": " << put_state_ns
+        << "}";
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    double seconds = 10;
+    std::vector<std::string> wanted;
+    if (!bench_args(argc, argv, { {"--seconds", &seconds} }, "patch", &wanted))
+        return 1;
+
+    const Patch **patches;
+    int count = faust_patches(&patches);
+    std::cout << "{\"sampling_rate\": " << SAMPLING_RATE
+        << ", \"seconds\": " << seconds
+        << ", \"block_size\": " << block_size
+        << ",\n\"patches\": [\n";
+    bool first = true;
+    for (int i = 0; i < count; i++) {
+        if (!wanted.empty() && std::find(wanted.begin(), wanted.end(),
+                patches[i]->name) == wanted.end())
+            continue;
+        if (!first)
+            std::cout << ",\n";
+        first = false;
+        std::cout << "    ";
+        bench(std::cout, patches[i], seconds);
+    }
+    std::cout << "\n]}\n";
+    return 0;
+}
@@ -2,6 +2,8 @@
 // This program is distributed under the terms of the GNU General Public
 // License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
 
+#include <algorithm>
+#include <math.h>
 #include <stdio.h>
 #include <vector>
 #include <utility>
@@ -24,6 +26,36 @@ faust_patches(const Patch ***patches)
     return all_patches_count;
 }
 
+const char *
+faust_name(const Patch *patch)
+{
+    return patch->name;
+}
+
+int
+faust_num_inputs(const Patch *patch)
+{
+    return patch->inputs;
+}
+
+int
+faust_num_outputs(const Patch *patch)
+{
+    return patch->outputs;
+}
+
+size_t
+faust_get_state_size(const Patch *patch)
+{
+    return patch->size;
+}
+
+int
+faust_latency(const Patch *patch)
+{
+    return patch->latency();
+}
+
 int
 faust_metadata(const Patch *patch, const char ***keys, const char ***values)
 {
@@ -43,14 +75,13 @@ faust_metadata(const Patch *patch, const char ***keys, const char ***values)
 }
 
 int
-faust_controls(const Patch *patch, const char ***out_controls, char ***out_docs,
-    FAUSTFLOAT ***out_vals)
+faust_controls(
+    const Patch *patch, const char ***out_controls, char ***out_docs)
 {
-    std::vector<Patch::Widget> widgets(patch->getUiMetadata());
+    const std::vector<Patch::Widget> &widgets = patch->getUiMetadata();
     int size = widgets.size();
     const char **controls = (const char **) calloc(size, sizeof(char *));
     char **docs = (char **) calloc(size, sizeof(char *));
-    FAUSTFLOAT **vals = (FAUSTFLOAT **) calloc(size, sizeof(FAUSTFLOAT *));
 
     for (int i = 0; i < size; i++) {
         const Patch::Widget &w = widgets[i];
@@ -59,11 +90,9 @@ faust_controls(const Patch *patch, const char ***out_controls, char ***out_docs,
         else
             asprintf(docs + i, "init:%.3g, %.3g -- %.3g", w.init, w.min, w.max);
         controls[i] = w.label;
-        vals[i] = w.value;
     }
     *out_controls = controls;
     *out_docs = docs;
-    *out_vals = vals;
     return size;
 }
 
@@ -73,10 +102,93 @@ faust_initialize(const Patch *patch, int srate)
     return patch->allocate(srate);
 }
 
+void
+faust_destroy(Patch *patch)
+{
+    delete patch;
+}
+
+void
+faust_set_controls(
+    Patch *patch, const int *indices, const FAUSTFLOAT *values, int n)
+{
+    patch->setControls(indices, values, n);
+}
+
 void
 faust_render(Patch *patch, int frames, const float **controls, float **outputs)
 {
     patch->compute(frames, controls, outputs);
 }
 
+int
+faust_render_detect(Patch *patch, int frames, const float **controls,
+    float **outputs, float rms_db, float peak_db, int silent)
+{
+    patch->compute(frames, controls, outputs);
+    return silent_frames(
+        patch->outputs, frames, outputs, rms_db, peak_db, silent);
+}
+
+size_t
+faust_get_state(const Patch *patch, const char **state)
+{
+    return patch->getState((const Patch::State **) state);
+}
+
+void
+faust_put_state(Patch *patch, const char *state)
+{
+    patch->putState((const Patch::State *) state);
+}
+
+Voices *
+faust_voices_initialize(const Patch *patch, int srate, int count,
+    int max_release, float rms_db, float peak_db, int silence_hold)
+{
+    return new Voices(
+        patch, srate, count, max_release, rms_db, peak_db, silence_hold);
+}
+
+void
+faust_voices_destroy(Voices *voices)
+{
+    delete voices;
+}
+
+void
+faust_voices_render(Voices *voices, int frames, int notes, const int *ids,
+    const float **controls, float **outputs)
+{
+    voices->render(frames, notes, ids, controls, outputs);
+}
+
+int
+faust_voices_render_detect(Voices *voices, int frames, int notes,
+    const int *ids, const float **controls, float **outputs,
+    float rms_db, float peak_db, int silent)
+{
+    voices->render(frames, notes, ids, controls, outputs);
+    return silent_frames(
+        voices->patch->outputs, frames, outputs, rms_db, peak_db, silent);
+}
+
+size_t
+faust_voices_get_state_size(const Voices *voices)
+{
+    return voices->stateSize();
+}
+
+size_t
+faust_voices_get_state(Voices *voices, const char **state)
+{
+    return voices->getState(state);
+}
+
+void
+faust_voices_put_state(Voices *voices, const char *state)
+{
+    voices->putState(state);
+}
+
 }
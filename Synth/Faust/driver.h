@@ -9,6 +9,7 @@
 #include <faust/dsp/dsp.h>
 
 #include "Patch.h"
+#include "Voices.h"
 #include "fltk/TimeVector.h" // for ControlSample
 
 extern "C" {
@@ -22,10 +23,12 @@ extern "C" {
 // Get all instruments and their names.  Return the count.
 int faust_patches(const Patch ***patches);
 
-const char *faust_name(const Patch *patch) { return patch->name; }
-int faust_num_inputs(const Patch *patch) { return patch->inputs; }
-int faust_num_outputs(const Patch *patch) { return patch->outputs; }
-size_t faust_get_state_size(const Patch *patch) { return patch->size; }
+const char *faust_name(const Patch *patch);
+int faust_num_inputs(const Patch *patch);
+int faust_num_outputs(const Patch *patch);
+size_t faust_get_state_size(const Patch *patch);
+// Frames the output lags the controls, see Patch::latency.
+int faust_latency(const Patch *patch);
 
 // Get an array of null-terminated control strings.  This is the number of
 // inputs.
@@ -35,29 +38,68 @@ size_t faust_get_state_size(const Patch *patch) { return patch->size; }
 int faust_metadata(
     const Patch *patch, const char ***keys, const char ***values);
 
-// Get UI controls, with docs, and pointers to their values for modification.
+// Get UI controls, with docs.  A control is identified by its index in this
+// list, for faust_set_controls.
 //
 // The arrays are allocated.  Control strings are static, but docs are also
 // allocated.
-int faust_controls(const Patch *patch, const char ***out_controls,
-    char ***out_docs, FAUSTFLOAT ***out_vals);
+int faust_controls(
+    const Patch *patch, const char ***out_controls, char ***out_docs);
 
 // allocated Patch
 
 // Initilaize a new instrument.
 Patch *faust_initialize(const Patch *patch, int srate);
-void faust_destroy(Patch *patch) { delete patch; }
+void faust_destroy(Patch *patch);
+
+// Set n UI controls, identified by their indices from faust_controls.
+void faust_set_controls(
+    Patch *patch, const int *indices, const FAUSTFLOAT *values, int n);
 
 void faust_render(
     Patch *patch, int frames, const float **controls, float **outputs);
 
-size_t faust_get_state(const Patch *patch, const char **state) {
-    return patch->getState((const Patch::State **) state);
-}
+// Like faust_render, but also analyze the output for silence.  It's analyzed
+// in blocks, and a block is silent if its RMS is below rms_db and its peak is
+// below peak_db, in dB relative to 1.  'silent' is the number of silent frames
+// leading up to this chunk, and the return value is the number of silent
+// frames at its end, so the caller can stop when that exceeds a hold time.
+int faust_render_detect(Patch *patch, int frames, const float **controls,
+    float **outputs, float rms_db, float peak_db, int silent);
+
+size_t faust_get_state(const Patch *patch, const char **state);
 
 // Caller should assert the state size matches patch->size.
-void faust_put_state(Patch *patch, const char *state) {
-    patch->putState((const Patch::State *) state);
-}
+void faust_put_state(Patch *patch, const char *state);
+
+// Voices
+
+// Allocate 'count' instances of the patch to play overlapping notes.
+// A voice is freed when its note has ended and it has been silent for
+// silence_hold frames, by rms_db and peak_db as in faust_render_detect, or
+// after max_release frames.
+Voices *faust_voices_initialize(const Patch *patch, int srate, int count,
+    int max_release, float rms_db, float peak_db, int silence_hold);
+void faust_voices_destroy(Voices *voices);
+
+// Render 'notes' notes, identified by 'ids', with patch->inputs controls for
+// each, so controls[note * inputs + input].  The voices are mixed into
+// 'outputs'.
+void faust_voices_render(Voices *voices, int frames, int notes,
+    const int *ids, const float **controls, float **outputs);
+
+// Like faust_voices_render, but also analyze the mixed output for silence,
+// like faust_render_detect.
+int faust_voices_render_detect(Voices *voices, int frames, int notes,
+    const int *ids, const float **controls, float **outputs,
+    float rms_db, float peak_db, int silent);
+
+size_t faust_voices_get_state_size(const Voices *voices);
+
+// The state is valid until the next call to faust_voices_get_state.
+size_t faust_voices_get_state(Voices *voices, const char **state);
+
+// Caller should assert the state size matches faust_voices_get_state_size.
+void faust_voices_put_state(Voices *voices, const char *state);
 
 }
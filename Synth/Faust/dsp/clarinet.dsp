@@ -1,6 +1,8 @@
 import("stdfaust.lib");
 
 declare description "Clarinet model.";
+// Physical models alias at 44.1k.
+declare oversample "2";
 declare control0_pitch "Pitch signal.";
 declare control1_dyn "Dynamic signal.";
 
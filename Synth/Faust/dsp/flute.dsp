@@ -1,6 +1,8 @@
 import("stdfaust.lib");
 
 declare description "Flute model.";
+// Physical models alias at 44.1k.
+declare oversample "2";
 declare control0_gate "Gate.";
 declare control1_pitch "Pitch signal.";
 declare control2_dyn "Dynamic signal.";
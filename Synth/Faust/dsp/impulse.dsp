@@ -0,0 +1,6 @@
+// This is a test case for oversampling, see impulse_oversample.dsp.
+
+declare description "An impulse whenever dyn changes.";
+declare control0_dyn "Dynamic signal.";
+
+process(dyn) = dyn - dyn';
@@ -0,0 +1,8 @@
+// This is a test case for oversampling.  It should line up exactly with
+// impulse.dsp.
+
+declare description "An impulse whenever dyn changes, oversampled.";
+declare oversample "2";
+declare control0_dyn "Dynamic signal.";
+
+process(dyn) = dyn - dyn';
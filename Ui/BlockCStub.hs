@@ -106,8 +106,8 @@ update_entire_track update_ruler view_id tracknum tracklike merged set_style =
 -- | Unlike other Fltk functions, this doesn't throw if the ViewId is not
 -- found.  That's because it's called asynchronously when derivation is
 -- complete.
-set_track_signal :: ViewId -> TrackNum -> Track.TrackSignal -> Fltk ()
-set_track_signal view_id tracknum tsig = fltk $ return ()
+set_track_signal :: [(ViewId, TrackNum)] -> Track.TrackSignal -> Fltk ()
+set_track_signal tracks tsig = fltk $ return ()
 
 set_track_title :: ViewId -> TrackNum -> Text -> Fltk ()
 set_track_title view_id tracknum title = fltk $ return ()
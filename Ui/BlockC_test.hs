@@ -161,11 +161,12 @@ test_track_signal = do
             [(0, 1), (32, 0.5), (64, 0), (500, 0), (510, 1)]
     let tsig = Track.TrackSignal csig 0 1
     io_human "track gets signal" $
-        send $ BlockC.set_track_signal view 1 tsig
+        send $ BlockC.set_track_signal [(view, 1)] tsig
     io_human "signal offset" $
-        send $ BlockC.set_track_signal view 1 (tsig { Track.ts_shift = 4 })
+        send $ BlockC.set_track_signal [(view, 1)] (tsig { Track.ts_shift = 4 })
     io_human "signal warp" $
-        send $ BlockC.set_track_signal view 1 (tsig { Track.ts_stretch = 2 })
+        send $ BlockC.set_track_signal [(view, 1)]
+            (tsig { Track.ts_stretch = 2 })
 
     -- have to put in a DEBUG print to see if the memory was freed
     io_human "track gone and signal memory freed" $
@@ -108,16 +108,16 @@ sync_actions track_signals set_style updates = do
     views_of <- old_views_of updates <$> Ui.get
     concatMapM (run_update views_of track_signals set_style) updates
 
-set_track_signals :: Fltk.Channel -> [(ViewId, TrackNum, Track.TrackSignal)]
-    -> IO ()
-set_track_signals ui_chan tracks =
-    -- Make sure tracks is fully forced, because a hang on the fltk event loop
+-- | Each signal goes to a list of tracks, which share it.
+set_track_signals :: Fltk.Channel
+    -> [([(ViewId, TrackNum)], Track.TrackSignal)] -> IO ()
+set_track_signals ui_chan signals =
+    -- Make sure signals is fully forced, because a hang on the fltk event loop
     -- can be confusing.
-    tracks `DeepSeq.deepseq` Fltk.send_action ui_chan "set_track_signals" $
-        forM_ tracks $ \(view_id, tracknum, tsig) ->
-            set_track_signal view_id tracknum tsig
+    signals `DeepSeq.deepseq` Fltk.send_action ui_chan "set_track_signals" $
+        forM_ signals $ \(tracks, tsig) -> set_track_signal tracks tsig
 
-set_track_signal :: ViewId -> TrackNum -> Track.TrackSignal -> Fltk.Fltk ()
+set_track_signal :: [(ViewId, TrackNum)] -> Track.TrackSignal -> Fltk.Fltk ()
 set_track_signal = BlockC.set_track_signal
 
 -- | The play position selection bypasses all the usual State -> Diff -> Sync
@@ -456,7 +456,7 @@ insert_track state set_style block_id view_id tracknum dtrack tlike_id tlike
                 BlockC.set_track_title view_id tracknum (Track.track_title t)
             case Map.lookup (block_id, tid) track_signals of
                 Just tsig | Block.track_wants_signal flags t ->
-                    BlockC.set_track_signal view_id tracknum tsig
+                    BlockC.set_track_signal [(view_id, tracknum)] tsig
                 _ -> return ()
         _ -> return ()
     where
@@ -244,17 +244,39 @@ update_track(BlockWindow *view, int tracknum,
     }
 }
 
+int
+set_track_events(BlockWindow *view, int tracknum, double start, double end,
+    int nranks, const Event *events, const int *ranks, int count)
+{
+    return view->block.set_track_events(tracknum, ScoreTime(start),
+        ScoreTime(end), nranks, events, ranks, count);
+}
+
 void
-set_track_signal(BlockWindow *view, int tracknum, TrackSignal *tsig)
+set_track_signal(BlockWindow **views, const int *tracknums, int count,
+    TrackSignal *tsig, const ControlSample *samples, int length)
 {
+    if (count == 0)
+        return;
     // I pass a lot of empty TrackSignals, so use nullptr and avoid allocation.
-    static TrackSignal empty;
-    if (tsig == nullptr)
-        tsig = &empty;
-    std::string name = "'" + std::string(view->label()) + "':"
-        + std::to_string(tracknum);
-    tsig->calculate_val_bounds(name.c_str());
-    view->block.set_track_signal(tracknum, *tsig);
+    TrackSignal sig = tsig ? *tsig : TrackSignal();
+    SignalSamples *shared = nullptr;
+    if (length > 0) {
+        // The first track's signal is most likely the previous version of
+        // this one, so only the part that changed has to be looked at.
+        const TrackSignal *old =
+            views[0]->block.track_at(tracknums[0])->get_track_signal();
+        std::string name = "'" + std::string(views[0]->label()) + "':"
+            + std::to_string(tracknums[0]);
+        shared = SignalSamples::update(old ? old->samples : nullptr,
+            samples, length, name.c_str());
+    }
+    sig.set_samples(shared);
+    for (int i = 0; i < count; i++)
+        views[i]->block.set_track_signal(tracknums[i], sig);
+    // Each track has its own reference now.
+    if (shared)
+        shared->decref();
 }
 
 void
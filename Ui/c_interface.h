@@ -63,7 +63,16 @@ void remove_track(BlockWindow *view, int tracknum);
 void update_track(BlockWindow *view, int tracknum,
         Tracklike *track, Marklist **marklists, int nmarklists,
         double start, double end);
-void set_track_signal(BlockWindow *view, int tracknum, TrackSignal *tsig);
+// Replace the events with start in [start, end] of every rank, see
+// EventStore::set.  This takes ownership of the event text.
+int set_track_events(BlockWindow *view, int tracknum, double start,
+        double end, int nranks, const Event *events, const int *ranks,
+        int count);
+// Set the same signal on each (views[i], tracknums[i]).  'tsig' has the shift
+// and stretch, and may be nullptr if the signal is empty.  The samples are
+// copied once, and shared by all of the tracks.
+void set_track_signal(BlockWindow **views, const int *tracknums, int count,
+        TrackSignal *tsig, const ControlSample *samples, int length);
 void set_track_title(BlockWindow *view, int tracknum, const char *title);
 void set_track_title_focus(BlockWindow *view, int tracknum);
 void set_block_title_focus(BlockWindow *view);
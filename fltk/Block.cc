@@ -338,6 +338,7 @@ Block::set_zoom_attr(const Zoom &new_zoom)
     // make this a bit bigger
     ScoreTime max_offset = track_tile.time_end() - visible;
     clamped.offset = util::clamp(ScoreTime(0), max_offset, clamped.offset);
+    clamped.offset = clamped.to_time(clamped.to_pixels(clamped.offset));
     if (clamped == this->zoom)
         return;
     this->zoom = clamped;
@@ -555,6 +556,15 @@ Block::update_track(int tracknum, const Tracklike &track,
 }
 
 
+bool
+Block::set_track_events(int tracknum, ScoreTime start, ScoreTime end,
+    int nranks, const Event *events, const int *ranks, int count)
+{
+    return this->track_at(tracknum)->set_events(
+        start, end, nranks, events, ranks, count);
+}
+
+
 void
 Block::set_track_signal(int tracknum, const TrackSignal &tsig)
 {
@@ -140,6 +140,9 @@ public:
     void update_track(int tracknum, const Tracklike &track,
         ScoreTime start, ScoreTime end);
 
+    // Replace the events in the range, see EventStore::set.
+    bool set_track_events(int tracknum, ScoreTime start, ScoreTime end,
+        int nranks, const Event *events, const int *ranks, int count);
     // Update the signal for this track.
     void set_track_signal(int tracknum, const TrackSignal &tsig);
 
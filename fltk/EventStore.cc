@@ -0,0 +1,124 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include <algorithm>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+
+#include "EventStore.h"
+
+
+using std::vector;
+
+
+bool
+EventStore::set(ScoreTime start, ScoreTime end, int nranks,
+    const Event *events, const int *ranks, int count)
+{
+    bool all = start == ScoreTime(-1) && end == ScoreTime(-1);
+    if (!all && nranks != int(this->ranks.size())) {
+        for (int i = 0; i < count; i++) {
+            if (events[i].text)
+                free(const_cast<char *>(events[i].text));
+        }
+        return false;
+    }
+    if (all) {
+        clear();
+        this->ranks.resize(nranks);
+    }
+
+    // Split the new events by rank.  They're already sorted by start.
+    vector<Rank> added(nranks);
+    for (int i = 0; i < count; i++) {
+        ASSERT(0 <= ranks[i] && ranks[i] < nranks);
+        added[ranks[i]].push_back(Stored(events[i]));
+    }
+    for (int rank = 0; rank < nranks; rank++) {
+        Rank &stored = this->ranks[rank];
+        Rank::iterator low = stored.begin(), high = stored.end();
+        if (!all) {
+            low = std::lower_bound(stored.begin(), stored.end(), start,
+                [](const Stored &e, ScoreTime t) { return e.start < t; });
+            high = std::upper_bound(low, stored.end(), end,
+                [](ScoreTime t, const Stored &e) { return t < e.start; });
+        }
+        free_text(low, high);
+        low = stored.erase(low, high);
+        stored.insert(low, added[rank].begin(), added[rank].end());
+    }
+    return true;
+}
+
+
+// An event is before 'start' if it's strictly before, or if it's a negative
+// event at start, since its text goes above.  This is the same as
+// Ui.Events.split_lists.
+void
+EventStore::find(ScoreTime start, ScoreTime end,
+    vector<Event> *found, vector<int> *found_ranks) const
+{
+    found->clear();
+    found_ranks->clear();
+    vector<std::pair<const Stored *, int>> events;
+    for (int rank = 0; rank < int(ranks.size()); rank++) {
+        const Rank &stored = ranks[rank];
+        Rank::const_iterator it = std::lower_bound(
+            stored.begin(), stored.end(), start,
+            [](const Stored &e, ScoreTime t) {
+                return e.start < t || (e.start == t && e.is_negative());
+            });
+        if (it != stored.begin())
+            --it;
+        for (; it != stored.end(); ++it) {
+            events.push_back(std::make_pair(&*it, rank));
+            // Stop after the first one past the end.
+            if (it->start > end)
+                break;
+        }
+    }
+    // Each rank is sorted, and the ranks are in order, so a stable sort by
+    // start gets (start, rank).
+    std::stable_sort(events.begin(), events.end(),
+        [](const std::pair<const Stored *, int> &a,
+                const std::pair<const Stored *, int> &b) {
+            return a.first->start < b.first->start;
+        });
+    found->reserve(events.size());
+    found_ranks->reserve(events.size());
+    for (const auto &e : events) {
+        found->push_back(e.first->event());
+        found_ranks->push_back(e.second);
+    }
+}
+
+
+void
+EventStore::clear()
+{
+    for (const Rank &rank : ranks)
+        free_text(rank.begin(), rank.end());
+    ranks.clear();
+}
+
+
+int
+EventStore::size() const
+{
+    int size = 0;
+    for (const Rank &rank : ranks)
+        size += rank.size();
+    return size;
+}
+
+
+void
+EventStore::free_text(Rank::const_iterator begin, Rank::const_iterator end)
+{
+    for (; begin != end; ++begin) {
+        if (begin->text)
+            free(const_cast<char *>(begin->text));
+    }
+}
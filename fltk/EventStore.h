@@ -0,0 +1,81 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+/* The events of one EventTrack.
+
+    Haskell pushes changes into this with set_track_events, and EventTrack
+    draws from it, so drawing never has to call back into haskell.
+
+    Each merged track is a separate rank, and rank 0 is the track's own
+    events.  Each rank is sorted by start, and a negative event comes before
+    a positive one at the same time, the same as Ui.Events.
+*/
+
+#ifndef __EVENT_STORE_H
+#define __EVENT_STORE_H
+
+#include <vector>
+
+#include "Event.h"
+#include "global.h"
+
+
+class EventStore {
+public:
+    EventStore() {}
+    ~EventStore() { clear(); }
+
+    // Replace the events of every rank whose start is in [start, end] with
+    // 'events', which are sorted by (start, rank).  If start and end are both
+    // -1, replace all events.  This takes ownership of the event text.
+    //
+    // A partial update has to have the same number of ranks as there already
+    // are, since the events outside the range of a new rank are unknown.  If
+    // it doesn't, nothing changes, and it returns false so the caller can send
+    // all the events.
+    bool set(ScoreTime start, ScoreTime end, int nranks,
+        const Event *events, const int *ranks, int count);
+
+    // Get events from start to end, plus the one before and after, for each
+    // rank.  The drawing code needs to know if the previous event text would
+    // overlap the first one, and the next event might have negative duration,
+    // with its text above.  The results are sorted by (start, rank), and
+    // point to text owned by the store, so they're only valid until the next
+    // set.
+    void find(ScoreTime start, ScoreTime end,
+        std::vector<Event> *found, std::vector<int> *found_ranks) const;
+
+    void clear();
+    int size() const;
+
+private:
+    EventStore(const EventStore &) = delete;
+    EventStore &operator=(const EventStore &) = delete;
+
+    // Event has const fields, so it can't be erased from the middle of a
+    // vector.
+    struct Stored {
+        explicit Stored(const Event &e) : start(e.start), duration(e.duration),
+            text(e.text), style_id(e.style_id)
+        {}
+        Event event() const {
+            return Event(start, duration, text, style_id);
+        }
+        bool is_negative() const {
+            return duration < ScoreTime(0) || duration.negative_zero();
+        }
+
+        ScoreTime start;
+        ScoreTime duration;
+        const char *text;
+        StyleId style_id;
+    };
+    typedef std::vector<Stored> Rank;
+
+    static void free_text(Rank::const_iterator begin,
+        Rank::const_iterator end);
+    std::vector<Rank> ranks;
+};
+
+#endif
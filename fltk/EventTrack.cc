@@ -47,12 +47,28 @@ enum { MIN_PIXEL = -10000, MAX_PIXEL = 10000 };
 // TrackSignal //////////
 
 void
-TrackSignal::free_signals()
+TrackSignal::set_samples(SignalSamples *samples)
 {
-    if (signal)
-        free(signal);
+    this->samples = samples;
+    if (samples) {
+        val_min = samples->val_min;
+        val_max = std::max(1.0, samples->val_max);
+    } else {
+        val_min = 0;
+        val_max = 1;
+    }
+    // If it looks like a normalized control signal, then it's more convenient
+    // to see it on an absolute scale.
+    if (val_min >= 0 && val_max <= 1) {
+        val_min = 0;
+        val_max = 1;
+    } else if (val_min >= -1 && val_max <= 1) {
+        val_min = -1;
+        val_max = 1;
+    }
 }
 
+
 static bool
 compare_control_sample(const ControlSample &s1, const ControlSample &s2)
 {
@@ -62,14 +78,15 @@ compare_control_sample(const ControlSample &s1, const ControlSample &s2)
 int
 TrackSignal::find_sample(ScoreTime start) const
 {
-    if (!signal) {
+    if (!samples) {
         // Render was set but there is no signal... so just say nothing was
         // found.
         return 0;
     }
+    const ControlSample *signal = samples->samples.data();
     ControlSample sample(to_real(start), 0);
-    ControlSample *found =
-        std::lower_bound(signal, signal + length, sample,
+    const ControlSample *found =
+        std::lower_bound(signal, signal + length(), sample,
             compare_control_sample);
     // Back up one to make sure I have the sample before start.
     if (found > signal)
@@ -82,64 +99,34 @@ TrackSignal::find_sample(ScoreTime start) const
 double
 TrackSignal::val_at(int i) const
 {
-    ASSERT_MSG(signal, "val_at on empty track signal");
-    return util::normalize(this->val_min, this->val_max, signal[i].val);
+    ASSERT_MSG(samples, "val_at on empty track signal");
+    return util::normalize(this->val_min, this->val_max, at(i).val);
 }
 
 
 RealTime
 TrackSignal::time_at(int i) const
 {
-    ASSERT_MSG(signal, "time_at on empty track signal");
-    return signal[i].time;
+    ASSERT_MSG(samples, "time_at on empty track signal");
+    return at(i).time;
 }
 
 
 int
 TrackSignal::pixel_time_at(const Zoom &zoom, int i) const
 {
-    ASSERT_MSG(signal, "pixel_time_at on empty track signal");
-    return zoom.to_pixels(from_real(signal[i].time) - zoom.offset);
-}
-
-
-void
-TrackSignal::calculate_val_bounds(const char *track_name)
-{
-    RealTime last_time = -9999;
-    val_min = 9999;
-    val_max = 1;
-    for (ControlSample *s = signal; s < signal + length; s++) {
-        val_max = std::max(val_max, s->val);
-        val_min = std::min(val_min, s->val);
-        // Since I'm iterating over the signal I might as well check this.
-        // Unsorted samples will cause drawing glitches.  Coincident samples
-        // are explicit discontinuities, so they're ok.
-        if (s->time < last_time) {
-            DEBUG("track " << track_name << ": sample time decreased: "
-                << s->time << " < " << last_time);
-        }
-        last_time = s->time;
-    }
-    // If it looks like a normalized control signal, then it's more convenient
-    // to see it on an absolute scale.
-    if (val_min >= 0 && val_max <= 1) {
-        val_min = 0;
-        val_max = 1;
-    } else if (val_min >= -1 && val_max <= 1) {
-        val_min = -1;
-        val_max = 1;
-    }
+    ASSERT_MSG(samples, "pixel_time_at on empty track signal");
+    return zoom.to_pixels(from_real(at(i).time) - zoom.offset);
 }
 
 
 std::ostream &
 operator<<(std::ostream &os, const TrackSignal &sig)
 {
-    if (sig.signal) {
-        for (int i = 0; i < sig.length; i++) {
-            os << "sig[" << i << "] = " << sig.signal[i].time << " -> "
-                << sig.signal[i].val << '\n' ;
+    if (sig.samples) {
+        for (int i = 0; i < sig.length(); i++) {
+            os << "sig[" << i << "] = " << sig.at(i).time << " -> "
+                << sig.at(i).val << '\n' ;
         }
     } else {
         os << "EMPTY TRACK SIGNAL";
@@ -297,21 +284,32 @@ EventTrack::update(const Tracklike &track, ScoreTime start, ScoreTime end)
     }
 
     TrackSignal tsig = this->config.track_signal;
-    Config::free_haskell_fun_ptr(
-        reinterpret_cast<void *>(this->config.find_events));
     this->config = *track.track;
     // Copy the previous track signal over even though it might be out of date
     // now.  At the least I can't forget the pointers or there's a leak.
     this->config.track_signal = tsig;
 }
 
+bool
+EventTrack::set_events(ScoreTime start, ScoreTime end, int nranks,
+    const Event *events, const int *ranks, int count)
+{
+    // update() does the damage, since it comes with every change.
+    return this->event_store.set(start, end, nranks, events, ranks, count);
+}
+
+
 void
 EventTrack::set_track_signal(const TrackSignal &tsig)
 {
     if (this->config.track_signal.empty() && tsig.empty())
         return;
-    this->config.track_signal.free_signals();
-    // Copy over the pointers, I'm taking ownership now.
+    // The caller keeps its own reference.  Take mine before giving up the
+    // old one, in case they're the same.
+    if (tsig.samples)
+        tsig.samples->incref();
+    if (this->config.track_signal.samples)
+        this->config.track_signal.samples->decref();
     this->config.track_signal = tsig;
     this->redraw();
     if (!config.track_signal.empty()
@@ -324,9 +322,10 @@ EventTrack::set_track_signal(const TrackSignal &tsig)
 void
 EventTrack::finalize_callbacks()
 {
-    Config::free_haskell_fun_ptr(
-        reinterpret_cast<void *>(this->config.find_events));
-    this->config.track_signal.free_signals();
+    this->event_store.clear();
+    if (this->config.track_signal.samples)
+        this->config.track_signal.samples->decref();
+    this->config.track_signal = TrackSignal();
     this->ruler_overlay.delete_config();
 }
 
@@ -338,52 +337,54 @@ EventTrack::finalize_callbacks()
 void
 EventTrack::draw()
 {
-    IRect draw_area = f_util::rect(this);
     // DEBUG("damage: " << f_util::show_damage(damage()));
 
-    // I used to look for FL_DAMAGE_SCROLL and use fl_scroll() for a fast
-    // blit, but it was too hard to get right.  The biggest problem is that
-    // events are at floats which are then rounded to ints for pixel positions.
-    if (damage() == Track::DAMAGE_RANGE) {
-        // DEBUG("intersection draw_area with damaged_area: "
-        //     << SHOW_RANGE(draw_area) << " \\/ "
-        //     << SHOW_RANGE(damaged_area) << " = "
-        //     << SHOW_RANGE(draw_area.intersect(damaged_area)));
-        draw_area = draw_area.intersect(this->damaged_area);
-    } else {
-        // I could technically handle SCROLL, but I'd have to tweak the ruler's
-        // damaged_area to account for the scroll and that's too much bother
-        // right now.
-        this->damage(FL_DAMAGE_ALL);
-    }
-    if (draw_area.w <= 0 || draw_area.h <= 0)
-        return;
-
-    // DEBUG("draw " << get_title() << ": " << f_util::show_damage(damage())
-    //     << ": " << draw_area << " " << SHOW_RANGE(draw_area));
-    // When ruler_overlay.draw() is called it will redundantly clip again
-    // on damage_range, but that's ok because it needs the clip when called
-    // from RulerTrack::draw().
-    f_util::ClipArea clip_area(draw_area);
-
-    // TODO It might be cleaner to eliminate bg_box and just call fl_rectf
-    // and fl_draw_box myself.  But this draws the all-mighty bevel too.
-    this->draw_child(this->bg_box);
-
     // This is more than one pixel, but otherwise I draw on top of the
     // bevel on retina displays.
     IRect inside_bevel = f_util::rect(this);
     inside_bevel.x += 2; inside_bevel.w -= 3;
     inside_bevel.y += 2; inside_bevel.h -= 3;
-    f_util::ClipArea clip_area2(inside_bevel);
 
-    this->draw_area();
+    // A scroll blits what's still visible and only draws the new strip.
+    // Block snaps the zoom offset to whole pixels, so event positions, which
+    // are floats rounded to ints, all move by the same amount.
+    vector<IRect> draw_areas;
+    if (damage() == Track::DAMAGE_RANGE) {
+        // DEBUG("intersection draw_area with damaged_area: "
+        //     << SHOW_RANGE(f_util::rect(this)) << " \\/ "
+        //     << SHOW_RANGE(damaged_area));
+        draw_areas.push_back(f_util::rect(this).intersect(damaged_area));
+    } else if (!this->scroll_damage(inside_bevel, &draw_areas)) {
+        this->damage(FL_DAMAGE_ALL);
+        draw_areas.push_back(f_util::rect(this));
+    }
+
+    for (const IRect &area : draw_areas) {
+        if (area.w <= 0 || area.h <= 0)
+            continue;
+        // DEBUG("draw " << get_title() << ": "
+        //     << f_util::show_damage(damage()) << ": " << area << " "
+        //     << SHOW_RANGE(area));
+        // When ruler_overlay.draw() is called it will redundantly clip again
+        // on damage_range, but that's ok because it needs the clip when
+        // called from RulerTrack::draw().
+        f_util::ClipArea clip_area(area);
+
+        // TODO It might be cleaner to eliminate bg_box and just call fl_rectf
+        // and fl_draw_box myself.  But this draws the all-mighty bevel too.
+        this->draw_child(this->bg_box);
+
+        f_util::ClipArea clip_area2(inside_bevel);
+        this->draw_area();
+    }
     damaged_area.w = damaged_area.h = 0;
+    scroll_dy = 0;
 }
 
 
 static void
-show_found_events(ScoreTime start, ScoreTime end, Event *events, int count)
+show_found_events(
+    ScoreTime start, ScoreTime end, const Event *events, int count)
 {
     printf("%.2f-%.2f: %d events:", start.scale(1), end.scale(1), count);
     for (int i = 0; i < count; i++) {
@@ -408,15 +409,17 @@ is_empty(const char *str)
     return all_white;
 }
 
-static SymbolTable::Wrapped
+// The result is valid until the next wrap_text.
+static const SymbolTable::Wrapped &
 wrap_text(const Event &event, int width)
 {
     const EventStyle *event_style = StyleTable::get()->get(event.style_id);
     const SymbolTable::Style style(
         event_style->font, event_style->size, event_style->text_color.fl());
 
+    static const SymbolTable::Wrapped empty;
     if (is_empty(event.text))
-        return SymbolTable::Wrapped();
+        return empty;
     else
         return SymbolTable::get()->wrap(event.text, style, width);
 }
@@ -490,9 +493,12 @@ EventTrack::draw_area()
 
     // The results are sorted by (event_start, rank), so lower ranks always
     // come first.
-    Event *events;
-    int *ranks;
-    int count = this->config.find_events(&start, &end, &events, &ranks);
+    vector<Event> found;
+    vector<int> found_ranks;
+    this->event_store.find(start, end, &found, &found_ranks);
+    const Event *events = found.data();
+    const int *ranks = found_ranks.data();
+    int count = found.size();
     // If I comment it, I get an unused function warning.
     if (false)
         show_found_events(start, end, events, count);
@@ -506,7 +512,8 @@ EventTrack::draw_area()
     for (int i = 0; i < count; i++) {
         triggers[i] = y_start
             + this->zoom.to_pixels(events[i].start - this->zoom.offset);
-        const SymbolTable::Wrapped wrapped(wrap_text(events[i], wrap_width));
+        const SymbolTable::Wrapped &wrapped =
+            wrap_text(events[i], wrap_width);
         Align align = ranks[i] > 0 ? Right : Left;
         boxes[i] = compute_text_box(
             events[i], wrapped, x(), triggers[i], wrap_width, align,
@@ -526,16 +533,6 @@ EventTrack::draw_area()
         draw_upper_layer(i, events, align, boxes, triggers);
     }
     selection_overlay.draw(x(), track_start(), w(), zoom);
-
-    // Free text, allocated on the haskell side.
-    if (count) {
-        for (int i = 0; i < count; i++) {
-            if (events[i].text)
-                free(const_cast<char *>(events[i].text));
-        }
-        free(events);
-        free(ranks);
-    }
 }
 
 
@@ -620,6 +617,67 @@ draw_segment(RenderConfig::RenderStyle style, int min_x,
 }
 
 
+// Draw the range of several samples which land on the same pixel row.
+static void
+draw_span(RenderConfig::RenderStyle style, int min_x,
+    int low_x, int high_x, int offset)
+{
+    switch (style) {
+    case RenderConfig::render_line:
+        fl_line_style(FL_SOLID | FL_CAP_ROUND, 2);
+        fl_line(low_x, offset, high_x, offset);
+        break;
+    case RenderConfig::render_filled:
+        fl_line_style(FL_SOLID, 0);
+        fl_line(min_x, offset, high_x, offset);
+        break;
+    default:
+        // draw_segment complains about these.
+        break;
+    }
+}
+
+
+// Return the index of the last sample from i on which is still at pixel
+// 'offset'.  Zoomed out, a dense signal can have thousands of samples on
+// one pixel, so this gallops forward and then binary searches, instead of
+// looking at each one.
+static int
+last_at_pixel(const TrackSignal &tsig, const Zoom &zoom, int y, int i,
+    int offset)
+{
+    // Samples in [i, lo] are at offset, and hi is past it, or the end.
+    int lo = i;
+    int hi = i + 1;
+    for (int step = 1; hi < tsig.length()
+            && y + tsig.pixel_time_at(zoom, hi) <= offset; step *= 2)
+    {
+        lo = hi;
+        hi = lo + step;
+    }
+    hi = std::min(hi, tsig.length());
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        if (y + tsig.pixel_time_at(zoom, mid) <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+static int
+signal_x(const TrackSignal &tsig, int min_x, int max_x, double val)
+{
+    return floor(util::scale(double(min_x), double(max_x),
+        util::clamp(0.0, 1.0,
+            util::normalize(tsig.val_min, tsig.val_max, val))));
+}
+
+
+// Only samples from the one before 'start' to the first one past max_y are
+// looked at, and each pixel row gets at most a span and a segment.
 void
 EventTrack::draw_signal(int min_y, int max_y, ScoreTime start)
 {
@@ -628,7 +686,7 @@ EventTrack::draw_signal(int min_y, int max_y, ScoreTime start)
 
     const TrackSignal &tsig = config.track_signal;
     const int found = tsig.find_sample(start);
-    if (found == tsig.length)
+    if (found == tsig.length())
         return;
 
     const int y = this->track_start();
@@ -653,32 +711,43 @@ EventTrack::draw_signal(int min_y, int max_y, ScoreTime start)
         fl_line(xpos, min_y, xpos, max_y);
     }
 
-    for (int i = found; i < tsig.length; i++) {
+    fl_color(signal_color);
+    for (int i = found; i < tsig.length(); i++) {
         // I draw from offset to next_offset.
         // For the first sample, 'found' should be at or before start.
+        int offset = y + tsig.pixel_time_at(zoom, i);
+        if (offset > max_y)
+            break;
 
-        int xpos = floor(util::scale(double(min_x), double(max_x),
-            util::clamp(0.0, 1.0, tsig.val_at(i))));
+        // If more samples land on this pixel, draw their range as one span,
+        // and go on from the last one.
+        int last = last_at_pixel(tsig, zoom, y, i, offset);
+        if (last > i) {
+            double low, high;
+            tsig.samples->pyramid.bounds(
+                tsig.samples->samples.data(), i, last, &low, &high);
+            draw_span(config.render.style, min_x,
+                signal_x(tsig, min_x, max_x, low),
+                signal_x(tsig, min_x, max_x, high), offset);
+            i = last;
+        }
+
+        int xpos = signal_x(tsig, min_x, max_x, tsig.at(i).val);
         int next_xpos, next_offset;
-        if (i+1 >= tsig.length) {
+        if (i+1 >= tsig.length()) {
             // Out of signal, last sample goes to the bottom.
             next_xpos = xpos;
             next_offset = max_y;
         } else {
-            next_xpos = floor(util::scale(double(min_x), double(max_x),
-                util::clamp(0.0, 1.0, tsig.val_at(i+1))));
+            next_xpos = signal_x(tsig, min_x, max_x, tsig.at(i+1).val);
             next_offset = y + tsig.pixel_time_at(zoom, i+1);
         }
-
-        int offset = y + tsig.pixel_time_at(zoom, i);
-        // If the next sample is too close then don't draw this one.
         if (next_offset <= offset)
             continue;
 
         // DEBUG("sample " << i << "--" << i+1
         //     << " val " << xpos << "--" << next_xpos
         //     << ", " << offset << "--" << next_offset);
-        fl_color(signal_color);
         draw_segment(config.render.style, min_x,
             xpos, next_xpos, offset, next_offset);
     }
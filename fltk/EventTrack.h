@@ -15,36 +15,35 @@
 
 #include "AbbreviatedInput.h"
 #include "Event.h"
+#include "EventStore.h"
 #include "FloatingInput.h"
 #include "Track.h"
 #include "RulerOverlay.h"
 #include "SelectionOverlay.h"
+#include "SignalSamples.h"
 #include "TimeVector.h"
 #include "global.h"
 
 
 class TrackSignal {
 public:
-    TrackSignal() : signal(nullptr), val_min(0), val_max(0), length(0),
+    TrackSignal() : samples(nullptr), val_min(0), val_max(0),
         shift(0), stretch(1)
     {}
 
-    // The track containing the TrackSignal is responsible for the freeing of
-    // the signal pointers.
-    void free_signals();
-
-    // This pointer could be null if the signal is empty.
-    ControlSample *signal;
-    // The max and min values in 'signal', to normalize the display.
+    // This is shared, and the track containing the TrackSignal holds a
+    // reference.  It could be null if the signal is empty.
+    SignalSamples *samples;
+    // The range of values to display, set by set_samples.
     double val_min, val_max;
-    // Length of above signal.
-    int length;
 
     // These are to be applied to the signal's time values.
     ScoreTime shift;
     ScoreTime stretch;
 
-    bool empty() const { return signal == nullptr; }
+    bool empty() const { return samples == nullptr; }
+    int length() const { return samples ? samples->length() : 0; }
+    const ControlSample &at(int i) const { return samples->samples[i]; }
     RealTime to_real(ScoreTime p) const {
         return (p.multiply(stretch) + shift).to_real();
     }
@@ -52,6 +51,9 @@ public:
         return (ScoreTime::from_real(p) - shift).divide(stretch);
     }
 
+    // Set 'samples', and 'val_min' and 'val_max' from their bounds.  This
+    // doesn't change the reference count.
+    void set_samples(SignalSamples *samples);
     // Return the index of the sample before 'start', or 0.
     int find_sample(ScoreTime start) const;
     // Get the val at the given index, normalized between 0--1.
@@ -61,11 +63,6 @@ public:
     // Get the time pixel at the given index, taking shift, stretch, and the
     // given zoom into account.
     int pixel_time_at(const Zoom &zoom, int i) const;
-
-    // Set 'val_min' and 'val_max'.  Normally this would be called by the
-    // constructor, but since I construct manually from haskell I don't have
-    // one of those.
-    void calculate_val_bounds(const char *track_name);
 };
 
 std::ostream &operator<<(std::ostream &os, const TrackSignal &sig);
@@ -82,23 +79,16 @@ struct RenderConfig {
     Color color;
 };
 
-// TODO: as an optimization, I could cache the last set of found events plus
-// one before start and one after end.  Then if the next draw_area is within
-// that area (as it will be when scrolling smoothly) I can avoid the callback.
+// The events themselves are in the EventTrack's EventStore, see
+// set_track_events.
 class EventTrackConfig {
 public:
-    // Get events from start to end, ordered by pos.  Return the ScoreTime in
-    // pos, the events in 'events', and the count.
-    typedef int (*FindEvents)(ScoreTime *start_pos, ScoreTime *end_pos,
-            Event **ret_events, int **ret_ranks);
-
-    EventTrackConfig(Color bg_color, FindEvents find_events,
-            ScoreTime time_end, RenderConfig render_config) :
-        bg_color(bg_color), find_events(find_events), time_end(time_end),
-        render(render_config), track_signal()
+    EventTrackConfig(Color bg_color, ScoreTime time_end,
+            RenderConfig render_config) :
+        bg_color(bg_color), time_end(time_end), render(render_config),
+        track_signal()
     {}
     Color bg_color;
-    FindEvents find_events;
     ScoreTime time_end;
 
     RenderConfig render;
@@ -124,8 +114,13 @@ public:
     virtual ScoreTime time_end() const override;
     virtual void update(const Tracklike &track, ScoreTime start, ScoreTime end)
         override;
+    virtual bool set_events(ScoreTime start, ScoreTime end, int nranks,
+        const Event *events, const int *ranks, int count) override;
     // For the moment, only EventTracks can draw a signal.
     virtual void set_track_signal(const TrackSignal &tsig) override;
+    virtual const TrackSignal *get_track_signal() const override {
+        return &config.track_signal;
+    }
     virtual void finalize_callbacks() override;
     virtual std::string dump() const override;
 
@@ -158,6 +153,7 @@ private:
     void unfocus_title();
 
     EventTrackConfig config;
+    EventStore event_store;
     double brightness;
     Color bg_color;
 
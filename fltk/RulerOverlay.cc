@@ -2,6 +2,8 @@
 // This program is distributed under the terms of the GNU General Public
 // License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
 
+#include <algorithm>
+#include <vector>
 
 #include "alpha_draw.h"
 #include "SymbolTable.h"
@@ -11,6 +13,61 @@
 
 // Marklist
 
+// Past this many distinct zoom levels, the index gets too big, since each
+// mark is in the list of every level at or above its own.  Rulers only have a
+// handful, one for each rank.
+enum { max_zoom_levels = 16 };
+
+// The zoom at which a mark draws anything at all.
+static double
+visible_zoom(const Mark &mark)
+{
+    return mark.name
+        ? std::min(mark.zoom_level, mark.name_zoom_level) : mark.zoom_level;
+}
+
+
+Marklist::Marklist(const PosMark *marks, int length)
+    : references(1), next_named(0), length(length), marks(marks)
+{
+    for (int i = 0; i < length; i++)
+        zooms.push_back(visible_zoom(marks[i].mark));
+    std::sort(zooms.begin(), zooms.end());
+    zooms.erase(std::unique(zooms.begin(), zooms.end()), zooms.end());
+    if (zooms.size() > max_zoom_levels) {
+        zooms.clear();
+    } else {
+        zoom_index.resize(zooms.size());
+        for (int i = 0; i < length; i++) {
+            double zoom = visible_zoom(marks[i].mark);
+            for (size_t level = std::lower_bound(
+                        zooms.begin(), zooms.end(), zoom) - zooms.begin();
+                    level < zooms.size(); level++)
+            {
+                zoom_index[level].push_back(i);
+            }
+        }
+    }
+    if (length > 0 && marks[0].mark.name) {
+        next_named = 1;
+        while (next_named < length && !marks[next_named].mark.name)
+            next_named++;
+    }
+}
+
+
+const std::vector<int> *
+Marklist::visible(double zoom) const
+{
+    static const std::vector<int> empty;
+    if (zooms.empty())
+        return length == 0 ? &empty : nullptr;
+    size_t level = std::upper_bound(zooms.begin(), zooms.end(), zoom)
+        - zooms.begin();
+    return level == 0 ? &empty : &zoom_index[level - 1];
+}
+
+
 void
 Marklist::incref()
 {
@@ -33,6 +90,8 @@ Marklist::decref()
         free((void *) marks);
         // Make sure if someone uses it they get a segfault right away.
         marks = nullptr;
+        std::vector<double>().swap(zooms);
+        std::vector<std::vector<int>>().swap(zoom_index);
     }
 }
 
@@ -82,22 +141,6 @@ compare_marks(const PosMark &m1, const PosMark &m2)
 }
 
 
-static bool
-prev_text_is_first(const PosMark *begin, const PosMark *cur)
-{
-    if (cur == begin)
-        return false;
-    // True if the prev mark with name == begin
-    const PosMark *p = cur - 1;
-    for (;p >= begin; p--) {
-        if (p->mark.name) {
-            return p == begin;
-        }
-    }
-    return false;
-}
-
-
 static const PosMark *
 rewind_to_prev_visible(const PosMark *begin, const PosMark *cur, double zoom)
 {
@@ -133,16 +176,44 @@ RulerOverlay::draw(const IRect &box, const Zoom &zoom, const IRect &clip)
         const PosMark *marks_end = mlist->marks + mlist->length;
         const PosMark *m = std::lower_bound(mlist->marks, marks_end,
             PosMark(start, Mark()), compare_marks);
-        if (config.show_names && prev_text_is_first(mlist->marks, m))
-            m = mlist->marks;
-        else
-            m = rewind_to_prev_visible(mlist->marks, m, zoom.factor);
-        for (; m < marks_end; m++) {
-            int offset = box.y + zoom.to_pixels(m->pos - zoom.offset);
+        const bool from_first =
+            config.show_names && mlist->prev_text_is_first(m - mlist->marks);
+        // Return true when it's past the end of the clip.
+        auto draw_pos_mark = [&](const PosMark &pm) {
+            int offset = box.y + zoom.to_pixels(pm.pos - zoom.offset);
             bool drew_text = draw_mark(
-                box, zoom, m->pos == ScoreTime(0), offset, m->mark);
+                box, zoom, pm.pos == ScoreTime(0), offset, pm.mark);
             // There probably isn't any ruler text this tall.
-            if ((drew_text && m->pos > end) || offset > clip.b() + 15)
+            return (drew_text && pm.pos > end) || offset > clip.b() + 15;
+        };
+
+        const std::vector<int> *visible = mlist->visible(zoom.factor);
+        if (!visible) {
+            if (from_first)
+                m = mlist->marks;
+            else
+                m = rewind_to_prev_visible(mlist->marks, m, zoom.factor);
+            for (; m < marks_end; m++) {
+                if (draw_pos_mark(*m))
+                    break;
+            }
+            continue;
+        }
+        // Only look at the marks visible at this zoom.
+        auto i = std::lower_bound(
+            visible->begin(), visible->end(), int(m - mlist->marks));
+        if (from_first) {
+            i = visible->begin();
+        } else {
+            // Same as rewind_to_prev_visible, but only over visible marks.
+            while (i != visible->begin()) {
+                --i;
+                if (zoom.factor >= mlist->marks[*i].mark.zoom_level)
+                    break;
+            }
+        }
+        for (; i != visible->end(); ++i) {
+            if (draw_pos_mark(mlist->marks[*i]))
                 break;
         }
     }
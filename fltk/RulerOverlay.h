@@ -5,6 +5,8 @@
 #ifndef __RULER_OVERLAY_H
 #define __RULER_OVERLAY_H
 
+#include <vector>
+
 #include "Color.h"
 #include "f_util.h"
 
@@ -40,15 +42,35 @@ struct PosMark {
 // Marklists are reference-counted because they are frequently large, but
 // change rarely.  Haskell uses a ForeignPtr to hold one reference.
 // More documentation in 'Ui.BlockC'.
+//
+// A ruler has many more fine marks than coarse ones, and zoomed out most of
+// them are too small to see, so the marklist also keeps, for each distinct
+// zoom level, the indices of the marks visible at that zoom.  Drawing then
+// only has to look at the marks it will actually draw.
 class Marklist {
 public:
-    Marklist(const PosMark *marks, int length)
-        : references(1), length(length), marks(marks) {}
+    Marklist(const PosMark *marks, int length);
     void incref();
     void decref();
 
+    // Indices into 'marks' of the marks whose line or name is visible at
+    // this zoom, in order.  nullptr if there are too many zoom levels to
+    // index, in which case the caller has to look at every mark.
+    const std::vector<int> *visible(double zoom) const;
+    // True if the first mark has a name, and it's the last named mark before
+    // marks[i].
+    bool prev_text_is_first(int i) const {
+        return i > 0 && i <= next_named;
+    }
+
 private:
     int references;
+    // Sorted distinct zoom levels, and for each one, the marks visible at it.
+    std::vector<double> zooms;
+    std::vector<std::vector<int>> zoom_index;
+    // Index of the first named mark after marks[0], or 0 if marks[0] has no
+    // name.
+    int next_named;
 public:
     const int length;
     const PosMark *marks;
@@ -75,41 +75,43 @@ RulerTrack::finalize_callbacks()
 void
 RulerTrack::draw()
 {
-    IRect draw_area = f_util::rect(this);
-
-    // I used to look for FL_DAMAGE_SCROLL and use fl_scroll() for a fast
-    // blit, but it was too hard to get right.  The biggest problem is that
-    // events are at floats which are then rounded to ints for pixel positions.
     // DEBUG("damage: " << f_util::show_damage(damage()));
-    if (damage() == FL_DAMAGE_CHILD || damage() == Track::DAMAGE_RANGE) {
-        // Only CHILD damage means a selection was set.  But since I overlap
-        // with the child, I have to draw too.
-        // DEBUG("intersection with child: "
-        //     << SHOW_RANGE(draw_area) << " + "
-        //     << SHOW_RANGE(damaged_area) << " = "
-        //     << SHOW_RANGE(draw_area.intersect(damaged_area)));
-        draw_area = draw_area.intersect(this->damaged_area);
-    } else {
-        this->damage(FL_DAMAGE_ALL);
-    }
-    if (draw_area.w <= 0 || draw_area.h <= 0)
-        return;
-
-    // Prevent marks at the top and bottom from drawing outside the ruler.
-    f_util::ClipArea clip_area(draw_area);
-    this->draw_child(this->bg_box);
 
     // This is more than one pixel, but otherwise I draw on top of the bevel on
     // retina displays.
     IRect inside_bevel = f_util::rect(this);
     inside_bevel.x += 2; inside_bevel.w -= 3;
     inside_bevel.y += 2; inside_bevel.h -= 3;
-    f_util::ClipArea clip_area2(inside_bevel);
+
+    // A scroll blits what's still visible and only draws the new strip, see
+    // EventTrack::draw.
+    std::vector<IRect> draw_areas;
+    if (damage() == FL_DAMAGE_CHILD || damage() == Track::DAMAGE_RANGE) {
+        // Only CHILD damage means a selection was set.  But since I overlap
+        // with the child, I have to draw too.
+        // DEBUG("intersection with child: "
+        //     << SHOW_RANGE(f_util::rect(this)) << " + "
+        //     << SHOW_RANGE(damaged_area));
+        draw_areas.push_back(f_util::rect(this).intersect(damaged_area));
+    } else if (!this->scroll_damage(inside_bevel, &draw_areas)) {
+        this->damage(FL_DAMAGE_ALL);
+        draw_areas.push_back(f_util::rect(this));
+    }
 
     IRect box(x(), track_start(), w(), h() - (y()-track_start()));
-    this->ruler_overlay.draw(box, zoom, inside_bevel);
-    this->selection_overlay.draw(x(), track_start(), w(), zoom);
+    for (const IRect &area : draw_areas) {
+        if (area.w <= 0 || area.h <= 0)
+            continue;
+        // Prevent marks at the top and bottom from drawing outside the ruler.
+        f_util::ClipArea clip_area(area);
+        this->draw_child(this->bg_box);
+
+        f_util::ClipArea clip_area2(inside_bevel);
+        this->ruler_overlay.draw(box, zoom, inside_bevel);
+        this->selection_overlay.draw(x(), track_start(), w(), zoom);
+    }
     this->damaged_area.w = this->damaged_area.h = 0;
+    this->scroll_dy = 0;
 }
 
 
@@ -0,0 +1,167 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "util.h"
+
+#include "SignalSamples.h"
+
+
+// SignalPyramid
+
+void
+SignalPyramid::build(const ControlSample *samples, int length,
+    const SignalPyramid *old, int old_length, int same_before, int same_after)
+{
+    levels.clear();
+    // Level k pairs up buckets of the level below, or samples for level 0.
+    // An odd one out at the end goes into a bucket by itself.  The top level
+    // has a single bucket.
+    for (int k = 0; length > (1 << k); k++) {
+        const int size = 2 << k;
+        std::vector<Bounds> level((length + size - 1) / size);
+        for (int b = 0; b < int(level.size()); b++) {
+            const int start = b * size;
+            const int end = std::min(start + size, length);
+            // The old bucket has to cover exactly the same samples.
+            const bool reuse = old && k < int(old->levels.size())
+                && std::min(start + size, old_length) == end
+                && (end <= same_before
+                    || (length == old_length && start >= length - same_after));
+            Bounds &bounds = level[b];
+            if (reuse) {
+                bounds = old->levels[k][b];
+            } else if (k == 0) {
+                bounds.min = bounds.max = samples[start].val;
+                if (end - start > 1) {
+                    bounds.min = std::min(bounds.min, samples[start+1].val);
+                    bounds.max = std::max(bounds.max, samples[start+1].val);
+                }
+            } else {
+                const std::vector<Bounds> &below = levels[k-1];
+                bounds = below[b*2];
+                if (b*2 + 1 < int(below.size())) {
+                    bounds.min = std::min(bounds.min, below[b*2 + 1].min);
+                    bounds.max = std::max(bounds.max, below[b*2 + 1].max);
+                }
+            }
+        }
+        levels.push_back(std::move(level));
+    }
+}
+
+
+void
+SignalPyramid::bounds(const ControlSample *samples, int start, int end,
+    double *min, double *max) const
+{
+    *min = *max = samples[start].val;
+    int i = start;
+    while (i <= end) {
+        // Use the biggest bucket that starts at i and doesn't go past end.
+        // Buckets at the same level all have the same size, so a bucket of
+        // size 2^n starts on a multiple of 2^n.
+        int level = 0;
+        while (level < int(levels.size())
+                && (i & ((2 << level) - 1)) == 0
+                && i + (2 << level) - 1 <= end)
+        {
+            level++;
+        }
+        if (level == 0) {
+            *min = std::min(*min, samples[i].val);
+            *max = std::max(*max, samples[i].val);
+            i++;
+        } else {
+            const Bounds &b = levels[level-1][i >> level];
+            *min = std::min(*min, b.min);
+            *max = std::max(*max, b.max);
+            i += 1 << level;
+        }
+    }
+}
+
+
+// SignalSamples
+
+static bool
+same_sample(const ControlSample &s1, const ControlSample &s2)
+{
+    return s1.time == s2.time && s1.val == s2.val;
+}
+
+
+SignalSamples *
+SignalSamples::update(SignalSamples *old, const ControlSample *samples,
+    int length, const char *name)
+{
+    int same_before = 0, same_after = 0;
+    if (old) {
+        const int old_length = old->length();
+        const int shortest = std::min(length, old_length);
+        while (same_before < shortest
+                && same_sample(old->samples[same_before],
+                    samples[same_before]))
+        {
+            same_before++;
+        }
+        if (same_before == length && length == old_length) {
+            old->incref();
+            return old;
+        }
+        while (same_after < shortest - same_before
+                && same_sample(old->samples[old_length - 1 - same_after],
+                    samples[length - 1 - same_after]))
+        {
+            same_after++;
+        }
+    }
+    return new SignalSamples(
+        old, samples, length, same_before, same_after, name);
+}
+
+
+SignalSamples::SignalSamples(const SignalSamples *old,
+        const ControlSample *samples, int length,
+        int same_before, int same_after, const char *name) :
+    samples(samples, samples + length), val_min(0), val_max(0), references(1)
+{
+    pyramid.build(samples, length,
+        old ? &old->pyramid : nullptr, old ? old->length() : 0,
+        same_before, same_after);
+    if (length > 0)
+        pyramid.bounds(samples, 0, length - 1, &val_min, &val_max);
+
+    // Unsorted samples will cause drawing glitches.  Coincident samples are
+    // explicit discontinuities, so they're ok.  The unchanged parts were
+    // already checked.
+    const int end = std::min(length - 1, length - same_after);
+    for (int i = std::max(1, same_before); i <= end; i++) {
+        if (samples[i].time < samples[i-1].time) {
+            DEBUG("track " << name << ": sample time decreased: "
+                << samples[i].time << " < " << samples[i-1].time);
+        }
+    }
+}
+
+
+void
+SignalSamples::incref()
+{
+    ASSERT(references > 0);
+    references++;
+}
+
+
+void
+SignalSamples::decref()
+{
+    ASSERT(references > 0);
+    references--;
+    if (references == 0)
+        delete this;
+}
@@ -0,0 +1,75 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+/* The samples of a TrackSignal.
+
+    The same signal is shown on its track in every view of the block, so the
+    samples are reference counted like Marklist, and each view holds a
+    reference.  They're immutable, so an update makes a new SignalSamples,
+    but it takes what it can from the previous version, so only the part of
+    the signal that changed has to be scanned.
+*/
+
+#ifndef __SIGNAL_SAMPLES_H
+#define __SIGNAL_SAMPLES_H
+
+#include <vector>
+
+#include "TimeVector.h"
+
+
+// The min and max val of a signal over power-of-two runs of samples.
+// When zoomed out, many samples land on the same pixel, and this lets
+// EventTrack::draw_signal get their range without looking at each one.
+class SignalPyramid {
+public:
+    // If 'old' is given, it was built from 'old_length' samples, of which the
+    // first 'same_before' and last 'same_after' are the same as these.
+    // Buckets that only cover those samples are copied from it.
+    void build(const ControlSample *samples, int length,
+        const SignalPyramid *old, int old_length,
+        int same_before, int same_after);
+    // Get the min and max val of samples [start, end].
+    void bounds(const ControlSample *samples, int start, int end,
+        double *min, double *max) const;
+
+private:
+    struct Bounds {
+        double min, max;
+    };
+    // levels[k] has the bounds of samples [i * 2^(k+1), (i+1) * 2^(k+1)).
+    // Level 0 would be the samples themselves, so it's not stored.
+    std::vector<std::vector<Bounds>> levels;
+};
+
+
+class SignalSamples {
+public:
+    // Make a SignalSamples with a copy of 'samples', with one reference for
+    // the caller.  If 'old' is given, anything at the start or end that is
+    // the same as in 'old' is taken from it, and if nothing changed, this
+    // returns 'old' with another reference.  'name' is for warnings.
+    static SignalSamples *update(SignalSamples *old,
+        const ControlSample *samples, int length, const char *name);
+    void incref();
+    void decref();
+
+    int length() const { return samples.size(); }
+
+    const std::vector<ControlSample> samples;
+    // The min and max val.  These are not normalized, TrackSignal does that.
+    double val_min, val_max;
+    SignalPyramid pyramid;
+
+private:
+    SignalSamples(const SignalSamples *old, const ControlSample *samples,
+        int length, int same_before, int same_after, const char *name);
+    // Only decref deletes it.
+    ~SignalSamples() {}
+    SignalSamples(const SignalSamples &) = delete;
+    SignalSamples &operator=(const SignalSamples &) = delete;
+    int references;
+};
+
+#endif
@@ -0,0 +1,125 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+#ifndef __STRING_TABLE_H
+#define __STRING_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+
+// A pointer and length into someone else's string, so a piece of a string can
+// be looked up without copying it out.
+struct StringView {
+    StringView() : data(""), size(0) {}
+    StringView(const char *data, size_t size) : data(data), size(size) {}
+    StringView(const char *s) : data(s), size(strlen(s)) {}
+    StringView(const std::string &s) : data(s.data()), size(s.size()) {}
+
+    bool operator==(const StringView &o) const {
+        return size == o.size && memcmp(data, o.data, size) == 0;
+    }
+    std::string str() const { return std::string(data, size); }
+
+    // FNV-1a.
+    uint32_t hash() const {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < size; i++)
+            h = (h ^ uint8_t(data[i])) * 16777619u;
+        return h;
+    }
+
+    const char *data;
+    size_t size;
+};
+
+
+// A string -> T hash table with open addressing and linear probing.  The
+// hash is stored with each key, so a probe only compares strings when the
+// hashes match.  Entries are never removed, only replaced.
+template <class T> class StringTable {
+public:
+    StringTable() : used(0), slots(initial_size) {}
+
+    // Return nullptr if it's not found.
+    const T *find(StringView key) const {
+        const Slot *slot = &slots[probe(key, key.hash())];
+        return slot->used ? &slot->val : nullptr;
+    }
+    T *find(StringView key) {
+        Slot *slot = &slots[probe(key, key.hash())];
+        return slot->used ? &slot->val : nullptr;
+    }
+
+    // Insert or replace, and return the stored value.
+    T &insert(const std::string &key, const T &val) {
+        // Keep it at most half full, so probes stay short.
+        if ((used + 1) * 2 > slots.size())
+            grow();
+        uint32_t hash = StringView(key).hash();
+        Slot &slot = slots[probe(key, hash)];
+        if (!slot.used) {
+            slot.used = true;
+            slot.hash = hash;
+            slot.key = key;
+            used++;
+        }
+        slot.val = val;
+        return slot.val;
+    }
+
+    size_t size() const { return used; }
+
+    // Call f(key, val) for each entry, in no particular order.
+    template <class F> void each(F f) const {
+        for (const Slot &slot : slots) {
+            if (slot.used)
+                f(slot.key, slot.val);
+        }
+    }
+
+private:
+    enum { initial_size = 64 }; // Must be a power of 2.
+
+    struct Slot {
+        Slot() : used(false), hash(0) {}
+        bool used;
+        uint32_t hash;
+        std::string key;
+        T val;
+    };
+
+    // Return the slot with the key, or the empty slot where it would go.
+    size_t probe(StringView key, uint32_t hash) const {
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot &slot = slots[i];
+            if (!slot.used
+                    || (slot.hash == hash && StringView(slot.key) == key))
+                return i;
+        }
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        for (Slot &slot : old) {
+            if (slot.used) {
+                Slot &to = slots[probe(slot.key, slot.hash)];
+                to.used = true;
+                to.hash = slot.hash;
+                to.key.swap(slot.key);
+                to.val = slot.val;
+            }
+        }
+    }
+
+    size_t used;
+    std::vector<Slot> slots;
+};
+
+#endif
@@ -2,6 +2,7 @@
 // This program is distributed under the terms of the GNU General Public
 // License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
 
+#include <algorithm>
 #include <string.h>
 
 #include <FL/fl_draw.H>
@@ -21,7 +22,10 @@ SymbolTable::SymbolTable()
 {
     int nfonts = Fl::set_fonts();
     for (int i = 0; i < nfonts; i++) {
-        this->font_map.insert(std::make_pair(string(Fl::get_font(i)), i));
+        // If there are duplicate names, the first one wins.
+        string name(Fl::get_font(i));
+        if (!font_map.find(name))
+            this->font_map.insert(name, i);
     }
 }
 
@@ -37,12 +41,12 @@ SymbolTable::font(const char *name) const
     // 'B' for bold, 'I' for italic, and 'P' for bold+italic.
     sname.insert(0, " ");
 #endif
-    std::map<string, Font>::const_iterator it = font_map.find(sname);
-    if (it == font_map.end()) {
+    const Font *found = font_map.find(sname);
+    if (!found) {
         DEBUG("font not found: '" << name << "'");
         return font_not_found;
     } else
-        return it->second;
+        return *found;
 }
 
 
@@ -50,11 +54,14 @@ char **
 SymbolTable::fonts() const
 {
     char **fonts = (char **) calloc(font_map.size() + 1, sizeof(char *));
+    // Sorted, as they were when font_map was a std::map.
+    std::vector<const string *> names;
+    font_map.each([&](const string &name, Font) { names.push_back(&name); });
+    std::sort(names.begin(), names.end(),
+        [](const string *a, const string *b) { return *a < *b; });
     char **cur = fonts;
-    std::map<string, Font>::const_iterator font = font_map.begin();
-    for (; font != font_map.end(); ++font) {
-        *cur++ = strdup(font->first.c_str());
-    }
+    for (const string *name : names)
+        *cur++ = strdup(name->c_str());
     *cur = nullptr;
     return fonts;
 }
@@ -62,24 +69,19 @@ SymbolTable::fonts() const
 void
 SymbolTable::insert(const string &name, const Symbol &sym)
 {
-    SymbolMap::iterator it = this->symbol_map.find(name);
-    if (it != symbol_map.end()) {
-        // Clear it out of the box_cache.
-        for (CacheMap::iterator cache = box_cache.begin();
-            cache != box_cache.end();)
-        {
-            // Trickiness to avoid incrementing an erased iterator.
-            if (cache->first.first == &it->second)
-                box_cache.erase(cache++);
-            else
-                ++cache;
-        }
-        for (size_t i = 0; i < it->second.glyphs.size(); i++) {
-            free(const_cast<char *>(it->second.glyphs[i].utf8));
+    Entry *old = this->symbol_map.find(name);
+    if (old) {
+        for (size_t i = 0; i < old->symbol.glyphs.size(); i++) {
+            free(const_cast<char *>(old->symbol.glyphs[i].utf8));
         }
-        symbol_map.erase(it);
     }
-    symbol_map.insert(std::make_pair(name, sym));
+    // Replacing the Entry also clears its box cache.
+    Entry entry;
+    entry.symbol = sym;
+    symbol_map.insert(name, entry);
+    // Any text that mentions the symbol will now be a different size.
+    wrap_cache.clear();
+    wrap_lru.clear();
 }
 
 // Draw the given text and return its width.
@@ -135,25 +137,42 @@ SymbolTable::measure(const string &text, size_t start, size_t end, Style style)
 }
 
 
+// Parse a size like "+3" or "-2", or return false if it isn't one.
+static bool
+parse_size(StringView text, SymbolTable::Size *size)
+{
+    if (text.size < 2 || (text.data[0] != '+' && text.data[0] != '-'))
+        return false;
+    int n = 0;
+    for (size_t i = 1; i < text.size; i++) {
+        if (text.data[i] < '0' || text.data[i] > '9')
+            return false;
+        n = n * 10 + (text.data[i] - '0');
+    }
+    *size = text.data[0] == '-' ? -n : n;
+    return true;
+}
+
+
 static SymbolTable::ParsedSymbol
-parse_symbol(const std::string &text)
+parse_symbol(StringView text)
 {
     using ParsedSymbol = SymbolTable::ParsedSymbol;
 
-    const char *divider = strchr(text.c_str(), '/');
-    // DEBUG("parse " << text);
-    if (divider == nullptr) {
+    const char *divider =
+        static_cast<const char *>(memchr(text.data, '/', text.size));
+    // DEBUG("parse " << text.str());
+    if (divider == nullptr)
         return ParsedSymbol(text);
-    } else if (divider == text.c_str()) {
-        return ParsedSymbol(divider + 1);
-    } else if (text[0] == '+' || text[0] == '-') {
-        char *end;
-        int size = strtol(text.c_str(), &end, 10);
-        if (end != divider) {
-            return ParsedSymbol(text);
-        } else {
-            // DEBUG("found " << (divider + 1) << ": " << size);
-            return ParsedSymbol(divider + 1, size, 0);
+    const size_t len = divider - text.data;
+    StringView rest(divider + 1, text.size - len - 1);
+    if (len == 0) {
+        return ParsedSymbol(rest);
+    } else if (text.data[0] == '+' || text.data[0] == '-') {
+        SymbolTable::Size size;
+        if (parse_size(StringView(text.data, len), &size)) {
+            // DEBUG("found " << rest.str() << ": " << size);
+            return ParsedSymbol(rest, size, 0);
         }
     } else {
         static const std::vector<std::pair<const char *, Fl_Font>> table =
@@ -161,11 +180,10 @@ parse_symbol(const std::string &text)
             , { "italic", FL_ITALIC }
             , { "bold+italic", FL_BOLD | FL_ITALIC }
             };
-        int len = divider - text.c_str();
         for (const auto &p : table) {
-            if (strncmp(text.c_str(), p.first, len) == 0) {
-                // DEBUG("found " << (divider + 1) << ": " << p.second);
-                return ParsedSymbol(divider + 1, 0, p.second);
+            if (strncmp(text.data, p.first, len) == 0) {
+                // DEBUG("found " << rest.str() << ": " << p.second);
+                return ParsedSymbol(rest, 0, p.second);
             }
         }
     }
@@ -175,35 +193,33 @@ parse_symbol(const std::string &text)
 
 DPoint
 SymbolTable::draw_backticks(
-    const std::string &text, IPoint pos, const Style &style, bool measure)
-    const
+    StringView text, IPoint pos, const Style &style, bool measure) const
 {
     ParsedSymbol parsed(parse_symbol(text));
 
     if (parsed.size != 0 || parsed.attributes != 0) {
         fl_font(fl_font() + parsed.attributes, fl_size() + parsed.size);
         double width = draw_text(
-            parsed.text.c_str(), parsed.text.size(), pos, measure, DPoint());
+            parsed.text.data, parsed.text.size, pos, measure, DPoint());
         return DPoint(width, fl_height() - fl_descent());
     } else {
-        SymbolMap::const_iterator it = this->symbol_map.find(parsed.text);
+        const Entry *entry = this->symbol_map.find(parsed.text);
 
-        if (it == symbol_map.end()) {
+        if (!entry) {
             // Unknown symbol, draw it as plain text including the ``s.
             double width = draw_text(
-                parsed.text.c_str(), parsed.text.size(), pos, measure,
-                DPoint());
+                parsed.text.data, parsed.text.size, pos, measure, DPoint());
             return DPoint(width, fl_height() - fl_descent());
         } else {
             // Draw symbol inside ``s.
-            IRect sym_box = this->measure_symbol(it->second, style.size);
+            IRect sym_box = this->measure_symbol(*entry, style.size);
             // The box measures the actual bounding box of the symbol.  Clip
             // out the spacing inserted by the characters by translating back
             // by the box's offsets.
             if (!measure) {
                 draw_symbol(
                     IPoint(pos.x - sym_box.x, pos.y + sym_box.y),
-                    it->second, style.size, 0);
+                    entry->symbol, style.size, 0);
             }
             return DPoint(sym_box.w, sym_box.h);
         }
@@ -235,7 +251,8 @@ SymbolTable::draw_or_measure(const string &text, size_t start, size_t end,
             measure, DPoint());
 
         DPoint sym_box = draw_backticks(
-            text.substr(i, j-i), IPoint(pos.x + box.x, pos.y), style, measure);
+            StringView(text.c_str() + i, j-i), IPoint(pos.x + box.x, pos.y),
+            style, measure);
         box.x += sym_box.x;
         box.y = std::max(box.y, sym_box.y);
         start = j + 1;
@@ -266,13 +283,12 @@ SymbolTable::measure_backticks(const char *text, Size size) const
         // Oops, it was unclosed.
         return -1;
     } else {
-        SymbolMap::const_iterator it = this->symbol_map.find(
-            string(start, text-start));
-        if (it == symbol_map.end()) {
+        const Entry *entry =
+            this->symbol_map.find(StringView(start, text-start));
+        if (!entry)
             return -1;
-        } else {
-            return this->measure_symbol(it->second, size).w;
-        }
+        else
+            return this->measure_symbol(*entry, size).w;
     }
 }
 
@@ -327,8 +343,50 @@ next_symbol(const string &text, size_t start)
     }
 }
 
+enum {
+    // Layouts kept by wrap().  This should be comfortably more than the
+    // events visible at once.
+    wrap_cache_size = 4096
+};
+
+SymbolTable::WrapKey::WrapKey(StringView text, Font font, Size size, int width)
+    : text(text), font(font), size(size), width(width)
+{
+    hash = text.hash();
+    hash = hash * 31 + font;
+    hash = hash * 31 + size;
+    hash = hash * 31 + width;
+}
+
+
+const SymbolTable::Wrapped &
+SymbolTable::wrap(StringView text, const Style &style, int wrap_width) const
+{
+    WrapKey key(text, style.font, style.size, wrap_width);
+    auto found = wrap_cache.find(key);
+    if (found != wrap_cache.end()) {
+        wrap_cache_stats.hits++;
+        // Move it to the front.
+        wrap_lru.splice(wrap_lru.begin(), wrap_lru, found->second);
+        return found->second->lines;
+    }
+    wrap_cache_stats.misses++;
+    // Only now copy the text, and key the cache on the entry's copy.
+    wrap_lru.emplace_front(key);
+    WrapEntry &entry = wrap_lru.front();
+    entry.lines = do_wrap(entry.text, style, wrap_width);
+    wrap_cache.insert(std::make_pair(entry.key, wrap_lru.begin()));
+    if (wrap_lru.size() > wrap_cache_size) {
+        wrap_cache.erase(wrap_lru.back().key);
+        wrap_lru.pop_back();
+    }
+    return entry.lines;
+}
+
+
 SymbolTable::Wrapped
-SymbolTable::wrap(const string &text, const Style &style, int wrap_width) const
+SymbolTable::do_wrap(const string &text, const Style &style, int wrap_width)
+    const
 {
     std::vector<std::pair<string, DPoint>> lines;
     string line;
@@ -486,8 +544,20 @@ enum {
     text_pad_bottom = 0
 };
 
+// Both ways of finding the box draw the symbol at this point in a square of
+// size*3.  Due to boundary issues, drawing text that touches the bottom of a
+// box means drawing one above the bottom.  I don't totally understand this.
+static IPoint
+symbol_origin(SymbolTable::Size size)
+{
+    return IPoint(size, size*2 - 1);
+}
+
+
+// Find the box by drawing the symbol and looking at the pixels.  This is
+// slow, and needs a shown window, but it works for rotated glyphs.
 static IRect
-do_measure_symbol(const SymbolTable::Symbol &sym, SymbolTable::Size size)
+render_box(const SymbolTable::Symbol &sym, SymbolTable::Size size)
 {
     // I don't bother to guess how big it will be, so give it plenty of
     // room on all sides.
@@ -499,14 +569,45 @@ do_measure_symbol(const SymbolTable::Symbol &sym, SymbolTable::Size size)
     fl_rectf(-1, -1, w+2, h+2);
     fl_color(FL_BLACK);
 
-    // Due to boundary issues, drawing text that touches the bottom of a box
-    // means drawing one above the bottom.  I don't totally understand this.
-    draw_symbol(IPoint(size, size*2 - 1), sym, size, 0);
+    draw_symbol(symbol_origin(size), sym, size, 0);
     unsigned char *buf = fl_read_image(nullptr, 0, 0, w, h);
     fl_end_offscreen();
     IRect box = find_box(buf, w, h);
     delete[] buf;
     fl_delete_offscreen(screen);
+    return box;
+}
+
+
+// Find the box from the font's ink extents, without drawing anything.
+// fl_text_extents doesn't know about rotation, so this returns an empty box
+// for rotated glyphs.
+static IRect
+metrics_box(const SymbolTable::Symbol &sym, SymbolTable::Size size)
+{
+    const IPoint origin = symbol_origin(size);
+    IRect box;
+    for (const SymbolTable::Glyph &glyph : sym.glyphs) {
+        if (glyph.rotate != 0)
+            return IRect();
+        set_font(glyph, size);
+        int dx, dy, w, h;
+        fl_text_extents(glyph.utf8, dx, dy, w, h);
+        // This is the same offset draw_text uses.
+        IPoint pos = origin + IPoint(
+            glyph.align_x * fl_size(), glyph.align_y * fl_size());
+        box = box.union_(IRect(pos.x + dx, pos.y + dy, w, h));
+    }
+    return box;
+}
+
+
+static IRect
+do_measure_symbol(const SymbolTable::Symbol &sym, SymbolTable::Size size)
+{
+    IRect box = metrics_box(sym, size);
+    if (box.w == 0 || box.h == 0)
+        box = render_box(sym, size);
 
     // Clip the extra spacing back off.  If the symbol extends before or above
     // the insertion point, this will be negative, meaning it should be shifted
@@ -535,13 +636,12 @@ do_measure_symbol(const SymbolTable::Symbol &sym, SymbolTable::Size size)
 }
 
 IRect
-SymbolTable::measure_symbol(const Symbol &sym, Size size) const
+SymbolTable::measure_symbol(const Entry &entry, Size size) const
 {
-    std::map<const CacheKey, IRect>::iterator it =
-        this->box_cache.find(std::make_pair(&sym, size));
-    if (it == box_cache.end()) {
-        IRect box = do_measure_symbol(sym, size);
-        box_cache.insert(std::make_pair(std::make_pair(&sym, size), box));
+    std::map<Size, IRect>::const_iterator it = entry.boxes.find(size);
+    if (it == entry.boxes.end()) {
+        IRect box = do_measure_symbol(entry.symbol, size);
+        entry.boxes.insert(std::make_pair(size, box));
         return box;
     } else {
         return it->second;
@@ -5,12 +5,15 @@
 #ifndef __SYMBOL_TABLE_H
 #define __SYMBOL_TABLE_H
 
+#include <list>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <utility>
 
 #include <FL/fl_draw.H>
 
+#include "StringTable.h"
 #include "config.h"
 #include "global.h"
 
@@ -87,12 +90,13 @@ public:
 
     // `+3/abc` => ParsedSymbol("abc", 3, 0)
     // `bold/abc` => ParsedSymbol("abc", 0, FL_BOLD)
+    // The text points into the string that was parsed.
     struct ParsedSymbol {
-        ParsedSymbol(std::string text, Size size = 0,
+        ParsedSymbol(StringView text, Size size = 0,
                 Fl_Font attributes = 0)
             : text(text), size(size), attributes(attributes)
         {}
-        std::string text;
+        StringView text;
         Size size;
         Fl_Font attributes; // 0, FL_BOLD, FL_ITALIC, FL_BOLD | FL_ITALIC
     };
@@ -110,8 +114,17 @@ public:
 
     // Wrapped words, as [(Line, BoundingBox)].
     typedef std::vector<std::pair<std::string, DPoint>> Wrapped;
-    Wrapped wrap(const std::string &text, const Style &style, int wrap_width)
-        const;
+    // This is cached, since it's called for every visible event on every
+    // draw.  The result is owned by the cache, and is valid until the next
+    // call to wrap or insert.
+    const Wrapped &wrap(
+        StringView text, const Style &style, int wrap_width) const;
+
+    struct CacheStats {
+        CacheStats() : hits(0), misses(0) {}
+        unsigned long hits, misses;
+    };
+    const CacheStats &wrap_stats() const { return wrap_cache_stats; }
 
     // Draw the text, rendering `` symbols in their proper font.  Symbols that
     // are not found are drawn as normal text.
@@ -124,35 +137,77 @@ public:
     DPoint measure(const std::string &text, size_t start, size_t end,
         Style style) const;
 
-    // Measure the Symbol by actually drawing it and seeing how many pixels it
-    // occupies.  This is expensive so it's cached.
-    //
-    // If this is called before the window is shown, it will crash horribly.
-    IRect measure_symbol(const Symbol &sym, Size size) const;
-
     static SymbolTable *get();
 private:
+    struct Entry {
+        Symbol symbol;
+        // Cache the exact dimensions of the glyphs by size, since the
+        // calculation process is gross and manual.  This goes away with the
+        // symbol when it's replaced.
+        mutable std::map<Size, IRect> boxes;
+    };
+
+    // Measure the box the Symbol's glyphs occupy, from the font metrics.
+    //
+    // Rotated glyphs are measured by actually drawing them and seeing how
+    // many pixels they occupy.  If that happens before the window is shown,
+    // it will crash horribly.
+    IRect measure_symbol(const Entry &entry, Size size) const;
+
     DPoint draw_or_measure(
         const std::string &text, size_t start, size_t end, IPoint pos,
         Style style, bool measure) const;
     DPoint draw_backticks(
-        const std::string &text, IPoint pos, const Style &style, bool measure)
-            const;
+        StringView text, IPoint pos, const Style &style, bool measure) const;
     int measure_backticks(const char *text, Size size) const;
     double measure_glyph(const char *p, int size) const;
 
+    Wrapped do_wrap(const std::string &text, const Style &style,
+        int wrap_width) const;
     DPoint wrap_glyphs(const std::string &text, int start, const Style &style,
         int wrap_width, int *wrap_at) const;
 
-    typedef std::map<std::string, Symbol> SymbolMap;
-    SymbolMap symbol_map;
-    std::map<std::string, Font> font_map;
-
-    typedef std::pair<const Symbol *, Size> CacheKey;
-    typedef std::map<const CacheKey, IRect> CacheMap;
-    // Cache the exact dimensions of the glyphs since the calculation process
-    // is gross and manual.
-    mutable CacheMap box_cache;
+    // These are looked up for every `symbol` drawn, so they're hash tables
+    // that can look up a piece of the text without copying it.
+    StringTable<Entry> symbol_map;
+    StringTable<Font> font_map;
+
+    // The color doesn't affect the layout, so it's not part of the key.  The
+    // text is a view, so a lookup doesn't have to copy the caller's text.  The
+    // keys stored in wrap_cache point to the text owned by their WrapEntry.
+    struct WrapKey {
+        WrapKey(StringView text, Font font, Size size, int width);
+        bool operator==(const WrapKey &o) const {
+            return hash == o.hash && font == o.font && size == o.size
+                && width == o.width && text == o.text;
+        }
+        StringView text;
+        Font font;
+        Size size;
+        int width;
+        size_t hash;
+    };
+    struct WrapKeyHash {
+        size_t operator()(const WrapKey &key) const { return key.hash; }
+    };
+    struct WrapEntry {
+        WrapEntry(const WrapKey &key) : text(key.text.str()), key(key) {
+            this->key.text = StringView(this->text);
+        }
+        // A copy's key would still point to the original's text.
+        WrapEntry(const WrapEntry &) = delete;
+        WrapEntry &operator=(const WrapEntry &) = delete;
+        std::string text;
+        WrapKey key;
+        Wrapped lines;
+    };
+    // Least recently used layouts are at the back.  List nodes don't move, so
+    // the keys in wrap_cache can point into them.
+    typedef std::list<WrapEntry> WrapList;
+    mutable WrapList wrap_lru;
+    mutable std::unordered_map<WrapKey, WrapList::iterator, WrapKeyHash>
+        wrap_cache;
+    mutable CacheStats wrap_cache_stats;
 };
 
 #endif
@@ -2,6 +2,9 @@
 // This program is distributed under the terms of the GNU General Public
 // License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
 
+#include <stdlib.h>
+#include <FL/fl_draw.H>
+
 #include "f_util.h"
 
 #include "EventTrack.h"
@@ -33,14 +36,66 @@ Track::set_zoom(const Zoom &new_zoom)
 {
     if (new_zoom == this->zoom)
         return;
-    if (this->zoom.factor == new_zoom.factor)
+    if (this->zoom.factor == new_zoom.factor) {
+        // Block::set_zoom_attr snaps offsets to whole pixels, so everything
+        // moves by the same number of pixels, and draw() can blit.
+        int dy = zoom.to_pixels(zoom.offset)
+            - new_zoom.to_pixels(new_zoom.offset);
+        this->scroll_dy += dy;
+        // A range damaged before the scroll moves with it.
+        this->damaged_area.y += dy;
         this->damage(FL_DAMAGE_SCROLL);
-    else
+    } else {
         this->damage(FL_DAMAGE_ALL);
+    }
     this->zoom = new_zoom;
 }
 
 
+static void
+scroll_exposed(void *arg, int x, int y, int w, int h)
+{
+    std::vector<IRect> *redraw = static_cast<std::vector<IRect> *>(arg);
+    redraw->push_back(IRect(x, y, w, h));
+}
+
+
+bool
+Track::scroll_damage(const IRect &area, std::vector<IRect> *redraw)
+{
+    if (damage() != FL_DAMAGE_SCROLL
+            && damage() != (FL_DAMAGE_SCROLL | DAMAGE_RANGE))
+        return false;
+    // Only blit what's visible, the rest may belong to another widget.
+    IRect visible;
+    fl_clip_box(area.x, area.y, area.w, area.h,
+        visible.x, visible.y, visible.w, visible.h);
+    if (abs(scroll_dy) >= visible.h)
+        return false;
+    // fl_scroll calls scroll_exposed with the strip that scrolled into view.
+    if (scroll_dy != 0) {
+        fl_scroll(visible.x, visible.y, visible.w, visible.h, 0, scroll_dy,
+            scroll_exposed, redraw);
+    }
+    if (damage() & DAMAGE_RANGE)
+        redraw->push_back(f_util::rect(this).intersect(damaged_area));
+    return true;
+}
+
+
+bool
+Track::set_events(ScoreTime start, ScoreTime end, int nranks,
+    const Event *events, const int *ranks, int count)
+{
+    DEBUG("WARNING: got events on a non-event track");
+    for (int i = 0; i < count; i++) {
+        if (events[i].text)
+            free(const_cast<char *>(events[i].text));
+    }
+    return true;
+}
+
+
 void
 Track::damage_range(ScoreTime start, ScoreTime end, bool selection)
 {
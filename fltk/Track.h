@@ -30,6 +30,7 @@
 class RulerConfig;
 class EventTrackConfig;
 class TrackSignal;
+struct Event;
 
 
 // Dividers are not shared between BlockWindows like tracks and rulers are, but
@@ -71,7 +72,9 @@ operator<<(std::ostream &os, const Tracklike &track)
 // Also acts like a union of Divider, Track, and Ruler.
 class Track : public Fl_Group {
 public:
-    explicit Track(const char *label=0) : Fl_Group(0, 0, 1, 1, label) {
+    explicit Track(const char *label=0) :
+        Fl_Group(0, 0, 1, 1, label), scroll_dy(0)
+    {
         this->labeltype(FL_NO_LABEL);
         end(); // This is a Group, but I don't want anything else to fall in.
         // DEBUG("created track " << this);
@@ -95,6 +98,13 @@ public:
     virtual void update(const Tracklike &track, ScoreTime start, ScoreTime end)
     {}
     virtual void set_track_signal(const TrackSignal &tsig) = 0;
+    // The signal set by set_track_signal, or nullptr if this kind of track
+    // doesn't have one.
+    virtual const TrackSignal *get_track_signal() const { return nullptr; }
+    // Replace events, see EventStore::set.  Only EventTracks have events, so
+    // the rest just free the text.
+    virtual bool set_events(ScoreTime start, ScoreTime end, int nranks,
+        const Event *events, const int *ranks, int count);
 
     // This is called before the object is deleted.
     virtual void finalize_callbacks() {}
@@ -118,9 +128,18 @@ protected:
     // Mark a segment of the track as needing to be redrawn.
     void damage_range(ScoreTime start, ScoreTime end, bool selection);
 
+    // If the track has only scrolled since the last draw, possibly with
+    // DAMAGE_RANGE too, blit what's still good in 'area' and return the
+    // areas that still have to be drawn.  Otherwise, return false, and the
+    // whole track has to be drawn.
+    bool scroll_damage(const IRect &area, std::vector<IRect> *redraw);
+
     enum { DAMAGE_RANGE = FL_DAMAGE_USER1 };
     // This area needs to be redrawn.
     IRect damaged_area;
+    // Pixels the contents have moved down since the last draw.  draw() should
+    // reset this.
+    int scroll_dy;
     Zoom zoom;
 };
 
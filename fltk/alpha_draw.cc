@@ -5,6 +5,12 @@
 /*
     Fancy alpha-channel using draw routines.
 */
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
 #include <FL/Fl_Image.H>
 #include <FL/fl_draw.H>
 
@@ -14,8 +20,59 @@
 #include "alpha_draw.h"
 
 
+enum {
+    // A rect is drawn by tiling it with images of this size.  Wide enough to
+    // cover a track, so ruler marks are a single draw.
+    tile_w = 256,
+    tile_h = 32,
+    // Drop all the tiles if there are more than this many colors.  There are
+    // only a handful of mark and selection colors, so this shouldn't happen.
+    max_tiles = 64
+};
+
+// A tile of a single color.  Fl_RGB_Image converts to a platform image the
+// first time it's drawn and keeps it, so after that drawing is just a
+// composite, done by XRender or Quartz if they're there.
+struct AlphaTile {
+    explicit AlphaTile(Color c) : data(tile_w * tile_h * 4) {
+        for (size_t i = 0; i < data.size(); i += 4) {
+            data[i] = c.r;
+            data[i+1] = c.g;
+            data[i+2] = c.b;
+            data[i+3] = c.a;
+        }
+        image.reset(new Fl_RGB_Image(data.data(), tile_w, tile_h, 4));
+    }
+    // The image doesn't own its data, so this has to outlive it.
+    std::vector<unsigned char> data;
+    std::unique_ptr<Fl_RGB_Image> image;
+};
+
+
+static Fl_RGB_Image *
+get_tile(Color c)
+{
+    // This is never freed, since the images shouldn't outlive the display.
+    static auto &tiles =
+        *new std::unordered_map<uint32_t, std::unique_ptr<AlphaTile>>();
+    uint32_t key = uint32_t(c.r) << 24 | uint32_t(c.g) << 16
+        | uint32_t(c.b) << 8 | uint32_t(c.a);
+    auto found = tiles.find(key);
+    if (found != tiles.end())
+        return found->second->image.get();
+    if (tiles.size() >= max_tiles)
+        tiles.clear();
+    AlphaTile *tile = new AlphaTile(c);
+    tiles[key].reset(tile);
+    return tile->image.get();
+}
+
+
 void alpha_rectf(IRect r, Color c)
 {
+    // Don't crash if the caller wants a negative sized rect.
+    if (r.w <= 0 || r.h <= 0)
+        return;
     if (!fl_not_clipped(r.x, r.y, r.w, r.h))
         return;
     // Fast path for no alpha.
@@ -24,18 +81,16 @@ void alpha_rectf(IRect r, Color c)
         fl_rectf(r.x, r.y, r.w, r.h);
         return;
     }
-    int nbytes = r.w * r.h * 4;
-    // Don't crash if the caller wants a negative sized rect.
-    if (nbytes <= 0)
-        return;
-    unsigned char *data = new unsigned char[nbytes];
-    for (int i = 0; i < nbytes; i+=4) {
-        data[i] = c.r;
-        data[i+1] = c.g;
-        data[i+2] = c.b;
-        data[i+3] = c.a;
+    // Only draw the visible part, since a selection can be much taller than
+    // the window.
+    int x, y, w, h;
+    fl_clip_box(r.x, r.y, r.w, r.h, x, y, w, h);
+    Fl_RGB_Image *tile = get_tile(c);
+    for (int ty = y; ty < y + h; ty += tile_h) {
+        for (int tx = x; tx < x + w; tx += tile_w) {
+            tile->draw(tx, ty,
+                std::min(int(tile_w), x + w - tx),
+                std::min(int(tile_h), y + h - ty));
+        }
     }
-    Fl_RGB_Image im(data, r.w, r.h, 4);
-    im.draw(r.x, r.y);
-    delete[] data;
 }
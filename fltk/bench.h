@@ -0,0 +1,87 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// Utilities shared by the benchmarks: a timer, and "--flag n" arguments.
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <chrono>
+#include <initializer_list>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+
+// Time an interval, from construction or the last lap.
+class BenchTimer {
+public:
+    BenchTimer() : start(Clock::now()) {}
+
+    // Nanoseconds since the start.
+    double ns() const {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start)
+            .count();
+    }
+    // Return ns() and restart, to time successive stages of a loop.
+    double lap_ns() {
+        Clock::time_point now = Clock::now();
+        double ns = std::chrono::duration<double, std::nano>(now - start)
+            .count();
+        start = now;
+        return ns;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start;
+};
+
+
+// A "--name n" argument, which sets an int or a double.
+struct BenchFlag {
+    BenchFlag(const char *name, int *i) : name(name), i(i), d(nullptr) {}
+    BenchFlag(const char *name, double *d) : name(name), i(nullptr), d(d) {}
+    const char *name;
+    int *i;
+    double *d;
+};
+
+// Parse argv into 'flags'.  If 'rest' is given, other arguments not starting
+// with '-' go there, and 'rest_name' describes them in the usage.  Anything
+// else prints usage to stderr and returns false.
+inline bool
+bench_args(int argc, const char **argv, std::initializer_list<BenchFlag> flags,
+    const char *rest_name = nullptr, std::vector<std::string> *rest = nullptr)
+{
+    for (int i = 1; i < argc; i++) {
+        const BenchFlag *found = nullptr;
+        for (const BenchFlag &flag : flags) {
+            if (strcmp(argv[i], flag.name) == 0 && i + 1 < argc)
+                found = &flag;
+        }
+        if (found) {
+            i++;
+            if (found->i)
+                *found->i = atoi(argv[i]);
+            else
+                *found->d = atof(argv[i]);
+        } else if (rest && argv[i][0] != '-') {
+            rest->push_back(argv[i]);
+        } else {
+            std::cerr << argv[0];
+            for (const BenchFlag &flag : flags)
+                std::cerr << " [ " << flag.name << " n ]";
+            if (rest)
+                std::cerr << " [ " << rest_name << " ... ]";
+            std::cerr << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,139 @@
+// Copyright 2018 Evan Laforge
+// This program is distributed under the terms of the GNU General Public
+// License 3.0, see COPYING or http://www.gnu.org/licenses/gpl-3.0.txt
+
+// Benchmark drawing a track full of `symbols`.
+//
+// This opens a window with one event track, fills it with events whose text
+// has symbols, size and bold prefixes, and unknown symbols, and then scrolls
+// through it, redrawing the whole window each frame.  It also times
+// SymbolTable::measure on the same text without drawing.  Results are JSON
+// on stdout.
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <FL/Fl.H>
+
+#include "Block.h"
+#include "EventTrack.h"
+#include "RulerTrack.h"
+#include "StyleTable.h"
+#include "SymbolTable.h"
+#include "bench.h"
+
+
+// Iterations for the SymbolTable::measure measurement.
+enum { measure_iterations = 20 };
+
+
+static const char *symbol_names[] = {
+    "1.", "1..", "dot", "x", "sharp", "flat", "tr", "arp"
+};
+
+static void
+insert_symbols()
+{
+    SymbolTable *t = SymbolTable::get();
+    for (const char *name : symbol_names) {
+        // The glyph text is owned by the SymbolTable.
+        t->insert(name, SymbolTable::Symbol(
+            SymbolTable::Glyph(strdup(name), Config::font, 2)));
+    }
+}
+
+
+// Every event has a few symbols, a size and bold prefix, and a `name` that's
+// not a symbol, which is drawn as text.
+static std::string
+event_text(int i)
+{
+    const int nsyms = sizeof symbol_names / sizeof *symbol_names;
+    char buf[128];
+    snprintf(buf, sizeof buf, "`%s` %d `+2/%d` `bold/b` `%s` `unknown%d`",
+        symbol_names[i % nsyms], i, i % 7, symbol_names[(i+3) % nsyms],
+        i % 5);
+    return buf;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int nevents = 4000;
+    int frames = 200;
+    if (!bench_args(argc, argv,
+            { {"--events", &nevents}, {"--frames", &frames} }))
+        return 1;
+
+    BlockWindow::initialize(nullptr);
+    StyleTable::get()->put(0, EventStyle(FL_HELVETICA, 12, Color::black,
+        Color::rgb_normalized(0.9, 0.9, 0.7)));
+    insert_symbols();
+
+    // Events are 4 apart, with a zoom that puts several on the screen.
+    const ScoreTime spacing(4);
+    const double factor = 8;
+    const ScoreTime time_end = ScoreTime(nevents * 4);
+    RulerConfig ruler(Color(255, 230, 160), false, true, true, false,
+        time_end);
+    EventTrackConfig track(Color(255, 255, 255), time_end,
+        RenderConfig(RenderConfig::render_none, Color::black));
+
+    BlockWindow *w = new BlockWindow(0, 0, 300, 800, "bench", BlockConfig());
+    w->testing = true;
+    w->block.insert_track(0, Tracklike(&ruler), 20);
+    w->block.insert_track(1, Tracklike(&track, &ruler), 250);
+
+    std::vector<Event> events;
+    std::vector<int> ranks;
+    std::vector<std::string> texts;
+    for (int i = 0; i < nevents; i++) {
+        texts.push_back(event_text(i));
+        // The track takes ownership of the text.
+        events.push_back(Event(ScoreTime(i * 4), spacing,
+            strdup(texts.back().c_str()), 0));
+        ranks.push_back(0);
+    }
+    w->block.set_track_events(1, ScoreTime(-1), ScoreTime(-1), 1,
+        events.data(), ranks.data(), events.size());
+    w->show();
+    Fl::flush();
+
+    // Scroll by part of a screen each frame, so each one has to draw new
+    // events, and wrap around at the end.
+    const ScoreTime visible = ScoreTime(800 / factor);
+    const ScoreTime step = ScoreTime(visible.scale(1) / 3);
+    ScoreTime offset(0);
+    BenchTimer timer;
+    for (int frame = 0; frame < frames; frame++) {
+        offset = offset + step;
+        if (offset + visible > time_end)
+            offset = ScoreTime(0);
+        w->block.set_zoom(Zoom(offset, factor));
+        w->redraw();
+        Fl::flush();
+    }
+    double draw_ns = timer.lap_ns();
+
+    const SymbolTable *symbols = SymbolTable::get();
+    const SymbolTable::Style style(FL_HELVETICA, 12, FL_BLACK);
+    for (int n = 0; n < measure_iterations; n++) {
+        for (const std::string &text : texts)
+            symbols->measure(text, 0, text.size(), style);
+    }
+    double measure_ns = timer.ns();
+
+    const SymbolTable::CacheStats &stats = symbols->wrap_stats();
+    std::cout << "{\"events\": " << nevents
+        << ", \"frames\": " << frames
+        << ", \"ms_per_frame\": " << (frames ? draw_ns / frames / 1e6 : 0)
+        << ", \"ns_per_measure\": "
+            << (nevents ? measure_ns / (nevents * measure_iterations) : 0)
+        << ", \"wrap_hits\": " << stats.hits
+        << ", \"wrap_misses\": " << stats.misses
+        << "}\n";
+    return 0;
+}
@@ -13,6 +13,7 @@
 #include "RulerTrack.h"
 #include "SkeletonDisplay.h"
 #include "SymbolTable.h"
+#include "bench.h"
 #include "f_util.h"
 
 
@@ -150,43 +151,23 @@ void t1_set()
      } }
 }
 
-int
-t1_find_events(ScoreTime *start_pos, ScoreTime *end_pos,
-        Event **ret_events, int **ret_ranks)
+// Push t1_events into the track, like haskell's set_track_events.
+void
+t1_set_events(Block &block, int tracknum)
 {
-    size_t count = 0;
-    size_t start = 0;
-    for (; start < t1_events.size(); start++) {
-        if (t1_events[start].event.start + t1_events[start].event.duration
-                >= *start_pos)
-            break;
-    }
-    while (start + count < t1_events.size()) {
-        if (t1_events[start+count].event.start >= *end_pos)
-            break;
-        count++;
+    std::vector<Event> events;
+    std::vector<int> ranks;
+    int nranks = 0;
+    for (const EventInfo &info : t1_events) {
+        events.push_back(info.event);
+        // The track takes ownership of the text.
+        if (info.event.text)
+            events.back().text = strdup(info.event.text);
+        ranks.push_back(info.rank);
+        nranks = std::max(nranks, info.rank + 1);
     }
-    start = 0;
-    count = t1_events.size();
-
-    *ret_events = (Event *) calloc(count, sizeof(Event));
-    *ret_ranks = (int *) calloc(count, sizeof(int));
-    for (size_t i = 0; i < count; i++) {
-        // Placement new since malloced space is uninitialized.
-        new((*ret_events) + i) Event(t1_events[start+i].event);
-        const char **textp = &(*ret_events)[i].text;
-        if (*textp)
-            *textp = strdup(*textp);
-        (*ret_ranks)[i] = t1_events[start+i].rank;
-    }
-    return count;
-}
-
-int
-t1_no_events(ScoreTime *start_pos, ScoreTime *end_pos,
-        Event **ret_events, int **ret_ranks)
-{
-    return 0;
+    block.set_track_events(tracknum, ScoreTime(-1), ScoreTime(-1), nranks,
+        events.data(), ranks.data(), events.size());
 }
 
 // Of course I don't actually need to finalize any FunPtrs here...
@@ -251,11 +232,10 @@ control_track_signal()
     //         << samples[i].val);
     // }
 
-    ts->signal = samples;
-    ts->length = length;
+    ts->set_samples(SignalSamples::update(nullptr, samples, length, "test"));
+    free(samples);
     ts->shift = ScoreTime(0);
     ts->stretch = ScoreTime(1);
-    ts->calculate_val_bounds("test");
     return ts;
 }
 
@@ -351,6 +331,75 @@ add_symbols()
     // t->load("v-angle-double", "\xef\xb8\xbd", "LiSong Pro", 4);
 }
 
+// A marklist like a long piece in 4/4: a rank 0 mark every 16 measures, and
+// ranks 1--3 for measures, beats, and 1/4 beats, which only show up when
+// zoomed in.
+static Marklist *
+alpha_marklist(int measures, ScoreTime *last_pos)
+{
+    static const Color colors[] = {
+        Color(116, 70, 0, 90), Color(116, 70, 0, 90),
+        Color(225, 100, 50, 90), Color(255, 150, 120, 60)
+    };
+    static const double zoom_levels[] = { 0, 0, 1, 4 };
+    const int length = measures * 16;
+    PosMark *marks = (PosMark *) calloc(sizeof(PosMark), length);
+    for (int i = 0; i < length; i++) {
+        int rank = i % 256 == 0 ? 0 : i % 16 == 0 ? 1 : i % 4 == 0 ? 2 : 3;
+        Mark m(rank, rank <= 1 ? 2 : 1, colors[rank], nullptr, 0,
+            zoom_levels[rank]);
+        marks[i] = PosMark(ScoreTime(i), m);
+    }
+    *last_pos = ScoreTime(length - 1);
+    return new Marklist(marks, length);
+}
+
+// Time redraws of event tracks whose rulers have thousands of translucent
+// marks, scrolling at several zooms.  The results go to stdout.
+static int
+bench_alpha_marks()
+{
+    const int frames = 100;
+    const int ntracks = 8;
+
+    ScoreTime last_pos;
+    Marklist *mlist = alpha_marklist(1000, &last_pos);
+    // RulerTracks never use alpha, so the marks go on EventTracks.
+    RulerConfig ruler(ruler_bg, false, true, true, false, last_pos);
+    EventTrackConfig track(track_bg, ScoreTime(0),
+        RenderConfig(RenderConfig::render_none, render_color));
+
+    BlockWindow *w = new BlockWindow(0, 0, 700, 800, "bench", block_config());
+    w->testing = true;
+    for (int i = 0; i < ntracks; i++) {
+        // Each track holds a reference.
+        mlist->incref();
+        ruler.marklists = Marklists(1, mlist);
+        w->block.insert_track(i, Tracklike(&track, &ruler), 80);
+    }
+    mlist->decref();
+    w->show();
+    Fl::flush();
+
+    for (double factor : { 0.5, 2.0, 8.0, 32.0 }) {
+        const ScoreTime visible(800 / factor);
+        const ScoreTime step(visible.scale(1) / 3);
+        ScoreTime offset(0);
+        BenchTimer timer;
+        for (int frame = 0; frame < frames; frame++) {
+            offset = offset + step;
+            if (offset + visible > last_pos)
+                offset = ScoreTime(0);
+            w->block.set_zoom(Zoom(offset, factor));
+            w->redraw();
+            Fl::flush();
+        }
+        std::cout << "zoom " << factor << ": " << timer.ns() / 1e6 / frames
+            << " ms/frame\n";
+    }
+    return 0;
+}
+
 static void
 timeout_func(void *unused)
 {
@@ -382,6 +431,8 @@ main(int argc, char **argv)
     BlockConfig config = block_config();
 
     BlockWindow::initialize(nullptr);
+    if (argc > 1 && strcmp(argv[1], "bench-alpha") == 0)
+        return bench_alpha_marks();
     t1_set();
     ScoreTime m44_last_pos;
     Marklist *m44_marks = m44_set(&m44_last_pos);
@@ -401,11 +452,11 @@ main(int argc, char **argv)
     ScoreTime t1_time_end = t1_events.size() == 0
         ? ScoreTime(0) : t1_events[i].event.start + t1_events[i].event.duration;
 
-    EventTrackConfig empty_track(track_bg, t1_no_events, t1_time_end,
+    EventTrackConfig empty_track(track_bg, ScoreTime(0),
             RenderConfig(RenderConfig::render_line, render_color));
-    EventTrackConfig track1(track_bg, t1_find_events, t1_time_end,
+    EventTrackConfig track1(track_bg, t1_time_end,
             RenderConfig(RenderConfig::render_line, render_color));
-    EventTrackConfig track2(track_bg, t1_find_events, t1_time_end,
+    EventTrackConfig track2(track_bg, t1_time_end,
             RenderConfig(RenderConfig::render_filled, render_color));
 
     BlockWindow *w =
@@ -424,6 +475,9 @@ main(int argc, char **argv)
         view.block.insert_track(3, Tracklike(&track2, &ruler), 40);
         view.block.insert_track(4, Tracklike(&empty_track, &ruler), 40);
         view.block.insert_track(5, Tracklike(&track2, &ruler), 80);
+        t1_set_events(view.block, 2);
+        t1_set_events(view.block, 3);
+        t1_set_events(view.block, 5);
 
         view.block.set_status("ABC`tamil-i` ABC `xie`", Color::white);
 
@@ -448,6 +502,7 @@ main(int argc, char **argv)
     } else {
         view.block.insert_track(0, Tracklike(&ruler), 20);
         view.block.insert_track(1, Tracklike(&track1, &no_ruler), 40);
+        t1_set_events(view.block, 1);
         view.block.track_at(1)->set_title("track title");
         // view.block.set_track_signal(1, *control_track_signal());
     }